@@ -0,0 +1,290 @@
+// Microbenchmarks for the backtracking JIT (make bench_micro): JIT::compile
+// and JIT::execute called directly in tight loops over fixed inputs, with
+// hardware counters read around each loop, and the code arena's syscalls
+// and chunks around each run of compiles. End-to-end timings of jitgrep
+// mix in I/O, line splitting and engine selection; these isolate the
+// generated code, so a CodeEmitter change shows up as cycles per byte.
+//
+//   bench_micro [pattern...]
+//
+// With no patterns a built-in set is run. Counters the kernel refuses
+// (perf_event_paranoid, containers, VMs without a PMU) print as "-", and
+// wall time is always reported.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include "code_arena.h"
+#include "jit.h"
+#include "regex.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Input scanned by the execute benchmarks, and how many times
+static const size_t INPUT_SIZE = 1 << 20;
+static const int PASSES = 8;
+
+// Compiles are repeated for at least this long per pattern size
+static const double COMPILE_MS = 100;
+
+static const char* const DEFAULT_PATTERNS[] = {
+    "ERROR",                      // fails on the first byte: entry and exit cost
+    "timeout",                    // literal with common first bytes
+    "(get|post|put|delete) /api", // alternation
+    "e.*ERROR",                   // star scanning to the end of the line
+    "(a|ab)*X",                   // backtracking into a star
+    "(?>e*)X",                    // atomic group
+    "^.*X$",                      // anchors
+};
+
+// Hardware counters for this thread, user space only. Each is opened on its
+// own, so one the CPU lacks (L1i misses often are) leaves the others.
+class Counters {
+public:
+    enum { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1I_MISSES, COUNT };
+
+    Counters() {
+        const std::pair<uint32_t, uint64_t> events[COUNT] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1I | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                     | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        };
+        for (int i = 0; i < COUNT; i++) {
+            perf_event_attr attr = {};
+            attr.size = sizeof attr;
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+            if (fds_[i] < 0 && error_.empty()) error_ = strerror(errno);
+        }
+    }
+
+    ~Counters() {
+        for (int fd : fds_) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    Counters(const Counters&) = delete;
+    Counters& operator=(const Counters&) = delete;
+
+    // Why a counter could not be opened, or empty if all were
+    const std::string& error() const { return error_; }
+
+    void start() {
+        for (int fd : fds_) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void stop() {
+        for (int i = 0; i < COUNT; i++) {
+            values_[i] = -1;
+            if (fds_[i] < 0) continue;
+            ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            // value, time enabled, time running; scaled up when the PMU
+            // was shared with other events
+            uint64_t data[3];
+            if (read(fds_[i], data, sizeof data) != sizeof data || data[2] == 0) continue;
+            values_[i] = static_cast<double>(data[0]) * data[1] / data[2];
+        }
+    }
+
+    // Count between the last start() and stop(), or -1 if unavailable
+    double operator[](int i) const { return values_[i]; }
+
+private:
+    int fds_[COUNT];
+    double values_[COUNT] = {};
+    std::string error_;
+};
+
+// `value / divisor`, printed in a column of `width`, or "-" if unavailable
+static void column(int width, double value, double divisor, int precision = 2) {
+    if (value < 0) {
+        printf(" %*s", width, "-");
+    } else {
+        printf(" %*.*f", width, precision, value / divisor);
+    }
+}
+
+// Lines of 80-200 lowercase words, the shape of log lines, from a fixed
+// seed so runs compare
+static std::string make_input() {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> line_length(80, 200), word_length(1, 9), letter('a', 'z');
+    std::string input;
+    input.reserve(INPUT_SIZE + 256);
+    while (input.size() < INPUT_SIZE) {
+        size_t eol = input.size() + line_length(rng);
+        while (input.size() < eol) {
+            for (int n = word_length(rng); n > 0; n--) input += static_cast<char>(letter(rng));
+            input += ' ';
+        }
+        input.back() = '\n';
+    }
+    return input;
+}
+
+// One pass the way JitMatcher::find runs the code: every start position of
+// each line until one matches. Returns the lines that matched.
+static uint64_t scan(JIT& jit, const std::string& input, bool captures, uint64_t& calls) {
+    const char* p = input.data();
+    const char* end = p + input.size();
+    std::vector<const char*> groups(captures ? 256 : 0);
+    uint64_t matched = 0;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        for (const char* s = p; s <= eol; s++) {
+            calls++;
+            if (captures ? jit.execute(s, p, eol, groups.data()) : jit.execute(s, p, eol)) {
+                matched++;
+                break;
+            }
+        }
+        p = eol + 1;
+    }
+    return matched;
+}
+
+static void bench_execute(const std::vector<std::string>& patterns, Counters& counters) {
+    std::string input = make_input();
+    printf("execute: %d passes over %zu bytes of %d-%d byte lines, all start positions\n\n",
+           PASSES, input.size(), 80, 200);
+    printf("%-28s %-8s %6s %8s %8s %8s %5s %10s %10s %8s\n", "pattern", "path", "lines", "ns/B", "cyc/B",
+           "ins/B", "IPC", "brmiss/KB", "L1imiss/KB", "cyc/call");
+
+    for (const std::string& pattern : patterns) {
+        std::shared_ptr<Node> root = parse_regex(pattern);
+        for (bool captures : {false, true}) {
+            if (captures && group_count(root.get()) > 127) continue;
+            JitOptions options;
+            options.captures = captures;
+            JIT jit;
+            jit.compile(root, options);
+
+            uint64_t calls = 0;
+            uint64_t matched = scan(jit, input, captures, calls); // warm caches and predictors
+            calls = 0;
+
+            counters.start();
+            auto start = Clock::now();
+            for (int i = 0; i < PASSES; i++) scan(jit, input, captures, calls);
+            double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            counters.stop();
+
+            double bytes = static_cast<double>(input.size()) * PASSES;
+            double cycles = counters[Counters::CYCLES], instructions = counters[Counters::INSTRUCTIONS];
+            printf("%-28.28s %-8s %6llu", pattern.c_str(), captures ? "captures" : "match",
+                   static_cast<unsigned long long>(matched));
+            column(8, ns, bytes);
+            column(8, cycles, bytes);
+            column(8, instructions, bytes);
+            column(5, cycles < 0 ? -1 : instructions, cycles);
+            column(10, counters[Counters::BRANCH_MISSES], bytes / 1024);
+            column(10, counters[Counters::L1I_MISSES], bytes / 1024);
+            column(8, cycles, static_cast<double>(calls), 1);
+            printf("\n");
+        }
+    }
+}
+
+// Alternations of `n` distinct words, compiled repeatedly into fresh JITs,
+// one CodeArena::Batch around each run of compiles or none. Parsing is left
+// out; sealing the code into the arena is in.
+static void bench_compile(Counters& counters) {
+    printf("\ncompile: alternations of N words, parse excluded\n\n");
+    printf("%6s %8s %8s %-6s %10s %12s %12s %10s %9s %7s\n", "N", "chars", "code B", "batch", "us", "cycles",
+           "instr", "L1imiss", "sys/comp", "chunks");
+
+    CodeArena& arena = CodeArena::instance();
+    for (size_t n = 1; n <= 4096; n *= 4) {
+        std::string pattern;
+        for (size_t i = 0; i < n; i++) {
+            if (i) pattern += '|';
+            pattern += "word" + std::to_string(i * 7919 % 100000);
+        }
+        std::shared_ptr<Node> root = parse_regex(pattern);
+        size_t code_size;
+        {
+            JIT jit;
+            jit.compile(root);
+            code_size = jit.code_size();
+        }
+
+        // Enough compiles to fill COMPILE_MS, from a timed first try
+        auto first = Clock::now();
+        JIT().compile(root);
+        double once = std::chrono::duration<double, std::milli>(Clock::now() - first).count();
+        size_t count = std::max<size_t>(3, std::min<size_t>(100000, COMPILE_MS / std::max(once, 1e-3)));
+
+        for (bool batched : {false, true}) {
+            // Created and destroyed outside the measurement
+            std::vector<std::unique_ptr<JIT>> jits(count);
+            for (auto& jit : jits) jit = std::make_unique<JIT>();
+
+            uint64_t syscalls = arena.syscalls();
+            counters.start();
+            auto start = Clock::now();
+            {
+                std::unique_ptr<CodeArena::Batch> batch;
+                if (batched) batch = std::make_unique<CodeArena::Batch>(arena);
+                for (auto& jit : jits) jit->compile(root);
+            }
+            double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            counters.stop();
+            syscalls = arena.syscalls() - syscalls;
+            size_t chunks = arena.chunk_count();
+            jits.clear();
+
+            printf("%6zu %8zu %8zu %-6s", n, pattern.size(), code_size, batched ? "yes" : "no");
+            column(10, ns, 1000.0 * count);
+            column(12, counters[Counters::CYCLES], count, 0);
+            column(12, counters[Counters::INSTRUCTIONS], count, 0);
+            column(10, counters[Counters::L1I_MISSES], count, 0);
+            column(9, syscalls, count, 3);
+            printf(" %7zu\n", chunks);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> patterns(argv + 1, argv + argc);
+    if (patterns.empty()) patterns.assign(std::begin(DEFAULT_PATTERNS), std::end(DEFAULT_PATTERNS));
+
+    try {
+        Counters counters;
+        if (!counters.error().empty()) {
+            std::cerr << "Warning: hardware counters unavailable (" << counters.error()
+                      << "), see /proc/sys/kernel/perf_event_paranoid\n";
+        }
+        bench_execute(patterns, counters);
+        bench_compile(counters);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+# Builds the JitRegex extension from jitgrep's own sources:
+#
+#     cd ext/jitregex && ruby extconf.rb && make
+#
+# or `make ruby-ext` from the top of jitgrep.
+require 'mkmf'
+
+src = File.expand_path('../../src', __dir__)
+$VPATH << src
+$INCFLAGS << " -I#{src}"
+$CXXFLAGS << ' -std=c++17 -O2'
+$srcs = %w[jitregex regex_parser jit code_arena matcher glushkov bitnfa].map { |f| "#{f}.cpp" }
+
+create_makefile('jitregex')
@@ -0,0 +1,97 @@
+// Ruby binding for jitgrep's matchers:
+//
+//     require 'jitregex'
+//     re = JitRegex.new('error.*timeout')
+//     re.match_lines(log).each { |r| puts log.byteslice(r) }
+//
+// match_lines scans the string's bytes where they are, with the engine
+// jitgrep itself would pick, and returns the byte range of each matching
+// line (without its '\n') as an exclusive Range.
+#include <ruby.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "matcher.h"
+
+struct JitRegex {
+    std::unique_ptr<Matcher> matcher;
+};
+
+static void jitregex_free(void* p) {
+    delete static_cast<JitRegex*>(p);
+}
+
+static const rb_data_type_t jitregex_type = {
+    "JitRegex",
+    {nullptr, jitregex_free, nullptr},
+    nullptr,
+    nullptr,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE jitregex_alloc(VALUE klass) {
+    return TypedData_Wrap_Struct(klass, &jitregex_type, new JitRegex);
+}
+
+// Same choice as jitgrep's auto engine: the bit-parallel NFA when the
+// pattern fits, the backtracking JIT otherwise
+static std::unique_ptr<Matcher> compile(const std::string& pattern) {
+    auto root = parse_regex(pattern);
+    if (!root) throw std::runtime_error("empty regex");
+    if (!needs_backtracking(root.get())) {
+        Glushkov glushkov({root});
+        if (glushkov.symbol.size() <= BitNfaMatcher::MAX_POSITIONS) {
+            return std::make_unique<BitNfaMatcher>(glushkov);
+        }
+    }
+    return std::make_unique<JitMatcher>(root, JitOptions());
+}
+
+static VALUE jitregex_initialize(VALUE self, VALUE pattern) {
+    JitRegex* re;
+    TypedData_Get_Struct(self, JitRegex, &jitregex_type, re);
+    StringValue(pattern);
+
+    // rb_raise must not unwind through C++ frames
+    std::string error;
+    try {
+        re->matcher = compile(std::string(RSTRING_PTR(pattern), RSTRING_LEN(pattern)));
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    if (!error.empty()) rb_raise(rb_eArgError, "%s", error.c_str());
+    return self;
+}
+
+static VALUE jitregex_match_lines(VALUE self, VALUE str) {
+    JitRegex* re;
+    TypedData_Get_Struct(self, JitRegex, &jitregex_type, re);
+    if (!re->matcher) rb_raise(rb_eRuntimeError, "uninitialized JitRegex");
+    StringValue(str);
+
+    // `str` stays on the stack, which keeps GC compaction from moving its
+    // bytes while the ranges are allocated
+    const char* begin = RSTRING_PTR(str);
+    const char* end = begin + RSTRING_LEN(str);
+    VALUE ranges = rb_ary_new();
+    const char* p = begin;
+    while (p < end) {
+        const char* hit = re->matcher->find(p, end);
+        if (hit == end) break;
+        const char* bol = hit;
+        while (bol > p && bol[-1] != '\n') bol--;
+        const char* eol = static_cast<const char*>(memchr(hit, '\n', end - hit));
+        if (!eol) eol = end;
+        rb_ary_push(ranges, rb_range_new(LONG2NUM(bol - begin), LONG2NUM(eol - begin), 1));
+        p = eol + 1;
+    }
+    RB_GC_GUARD(str);
+    return ranges;
+}
+
+extern "C" void Init_jitregex() {
+    VALUE klass = rb_define_class("JitRegex", rb_cObject);
+    rb_define_alloc_func(klass, jitregex_alloc);
+    rb_define_method(klass, "initialize", RUBY_METHOD_FUNC(jitregex_initialize), 1);
+    rb_define_method(klass, "match_lines", RUBY_METHOD_FUNC(jitregex_match_lines), 1);
+}
@@ -0,0 +1,278 @@
+#pragma once
+// Header-only, compile-time specialized regexes for patterns known at build
+// time. The pattern is parsed by a constexpr version of jitgrep's parser into
+// the same node vocabulary as regex.h, and every node becomes a template
+// instantiation, so the compiler sees the whole matcher and can inline it.
+// No JIT, no executable memory, no startup cost.
+//
+// C++17 cannot take a string literal as a template argument, so the pattern
+// is a constexpr character array with static storage:
+//
+//     static constexpr char error_timeout[] = "ERROR.*timeout";
+//     if (jitregex::static_regex<error_timeout>::search(line)) ...
+//
+// Semantics follow jitgrep: ^ matches at the start of the input, $ at its
+// end or before '\n', and . matches any byte but '\n'. An invalid pattern
+// fails to compile.
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+namespace jitregex {
+
+enum NodeType {
+    NODE_CHAR,
+    NODE_ANY, // .
+    NODE_CONCAT,
+    NODE_STAR,
+    NODE_OR,
+    NODE_START, // ^
+    NODE_END    // $
+};
+
+// Children are indices into the owning Ast; -1 is the empty pattern
+struct Node {
+    NodeType type = NODE_CHAR;
+    char c = 0;
+    int left = -1;  // CONCAT, OR; the child of STAR
+    int right = -1; // CONCAT, OR
+};
+
+template <size_t N>
+struct Ast {
+    Node nodes[N == 0 ? 1 : 2 * N];
+    int count = 0;
+    int root = -1;
+};
+
+namespace detail {
+
+constexpr size_t length(const char* s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+// Mirrors RegexParser in regex_parser.cpp. Errors throw, which is not a
+// constant expression and so stops compilation at the offending pattern.
+template <size_t N>
+class Parser {
+public:
+    constexpr explicit Parser(const char* pattern) : pattern_(pattern) {}
+
+    constexpr Ast<N> parse() {
+        if (N == 0) return ast_;
+        ast_.root = parse_or();
+        if (pos_ < N) throw "Unexpected character at end of regex";
+        return ast_;
+    }
+
+private:
+    const char* pattern_;
+    size_t pos_ = 0;
+    Ast<N> ast_{};
+
+    constexpr char peek() const { return pos_ < N ? pattern_[pos_] : '\0'; }
+    constexpr char advance() { return pos_ < N ? pattern_[pos_++] : '\0'; }
+
+    constexpr int add(NodeType type, char c = 0, int left = -1, int right = -1) {
+        Node& n = ast_.nodes[ast_.count];
+        n.type = type;
+        n.c = c;
+        n.left = left;
+        n.right = right;
+        return ast_.count++;
+    }
+
+    // Lowest precedence: |
+    constexpr int parse_or() {
+        int node = parse_concat();
+        while (peek() == '|') {
+            advance();
+            int right = parse_concat();
+            node = add(NODE_OR, 0, node, right);
+        }
+        return node;
+    }
+
+    // Mid precedence: concatenation (implicit)
+    constexpr int parse_concat() {
+        int node = -1;
+        while (pos_ < N && peek() != '|' && peek() != ')') {
+            int next = parse_star();
+            if (node < 0) {
+                node = next;
+            } else if (next >= 0) {
+                node = add(NODE_CONCAT, 0, node, next);
+            }
+        }
+        return node;
+    }
+
+    // High precedence: *
+    constexpr int parse_star() {
+        int node = parse_primary();
+        while (peek() == '*') {
+            advance();
+            if (node < 0) throw "Nothing to repeat before *";
+            node = add(NODE_STAR, 0, node);
+        }
+        return node;
+    }
+
+    // Highest precedence: atoms, (), ^, $, .
+    constexpr int parse_primary() {
+        char c = peek();
+        if (c == '(') {
+            advance();
+            int node = parse_or();
+            if (advance() != ')') throw "Unbalanced parentheses";
+            return node;
+        } else if (c == '.') {
+            advance();
+            return add(NODE_ANY);
+        } else if (c == '^') {
+            advance();
+            return add(NODE_START);
+        } else if (c == '$') {
+            advance();
+            return add(NODE_END);
+        } else if (c == '\\') {
+            advance();
+            if (pos_ >= N) throw "Trailing backslash";
+            return add(NODE_CHAR, advance());
+        } else if (c == '*' || c == '|' || c == ')') {
+            return -1;
+        } else {
+            advance();
+            return add(NODE_CHAR, c);
+        }
+    }
+};
+
+template <const char* Pattern>
+struct Compiled {
+    static constexpr size_t size = length(Pattern);
+    static constexpr Ast<size> ast = Parser<size>(Pattern).parse();
+};
+
+// Match the span of the input [begin, end) the code runs against
+struct Input {
+    const char* begin;
+    const char* end;
+};
+
+// Matcher for node I of A::ast, in continuation-passing style: run() matches
+// the node at `s` and calls `k` with each position where it can end, most
+// greedy first, until `k` accepts. Backtracking is the compiler's call stack.
+template <class A, int I>
+struct Match {
+    static constexpr Node node = A::ast.nodes[I];
+
+    template <class K>
+    static bool run(const char* s, const Input& in, const K& k) {
+        if constexpr (node.type == NODE_CHAR) {
+            return s < in.end && *s == node.c && k(s + 1);
+        } else if constexpr (node.type == NODE_ANY) {
+            return s < in.end && *s != '\n' && k(s + 1);
+        } else if constexpr (node.type == NODE_CONCAT) {
+            return Match<A, node.left>::run(s, in, [&](const char* t) {
+                return Match<A, node.right>::run(t, in, k);
+            });
+        } else if constexpr (node.type == NODE_OR) {
+            return Match<A, node.left>::run(s, in, k) || Match<A, node.right>::run(s, in, k);
+        } else if constexpr (node.type == NODE_STAR) {
+            return star(s, in, k);
+        } else if constexpr (node.type == NODE_START) {
+            return s == in.begin && k(s);
+        } else {
+            return (s == in.end || *s == '\n') && k(s);
+        }
+    }
+
+    // Greedy: one more iteration if it consumes input, else the rest
+    template <class K>
+    static bool star(const char* s, const Input& in, const K& k) {
+        bool more = Match<A, node.left>::run(s, in, [&](const char* t) {
+            return t != s && star(t, in, k);
+        });
+        return more || k(s);
+    }
+};
+
+// The empty pattern
+template <class A>
+struct Match<A, -1> {
+    template <class K>
+    static bool run(const char* s, const Input&, const K& k) {
+        return k(s);
+    }
+};
+
+// The byte every match must start with, or -1
+template <class A>
+constexpr int leading_byte(int i) {
+    while (i >= 0) {
+        const Node& n = A::ast.nodes[i];
+        if (n.type == NODE_CHAR) return (unsigned char)n.c;
+        if (n.type != NODE_CONCAT) return -1;
+        i = n.left;
+    }
+    return -1;
+}
+
+// True if every match must start at the beginning of the input
+template <class A>
+constexpr bool anchored(int i) {
+    while (i >= 0) {
+        const Node& n = A::ast.nodes[i];
+        if (n.type == NODE_START) return true;
+        if (n.type != NODE_CONCAT) return false;
+        i = n.left;
+    }
+    return false;
+}
+
+} // namespace detail
+
+template <const char* Pattern>
+class static_regex {
+    using A = detail::Compiled<Pattern>;
+    using Root = detail::Match<A, A::ast.root>;
+    static constexpr int leading = detail::leading_byte<A>(A::ast.root);
+    static constexpr bool is_anchored = detail::anchored<A>(A::ast.root);
+
+public:
+    // True if the pattern matches [begin, end) starting exactly at `at`
+    static bool match_at(const char* at, const char* begin, const char* end) {
+        detail::Input in{begin, end};
+        return Root::run(at, in, [](const char*) { return true; });
+    }
+
+    // True if the pattern matches anywhere in [begin, end)
+    static bool search(const char* begin, const char* end) {
+        if constexpr (is_anchored) {
+            return match_at(begin, begin, end);
+        } else if constexpr (leading >= 0) {
+            // Only positions holding the first byte can start a match
+            for (const char* s = begin; s < end; s++) {
+                s = static_cast<const char*>(memchr(s, leading, end - s));
+                if (!s) return false;
+                if (match_at(s, begin, end)) return true;
+            }
+            return false;
+        } else {
+            for (const char* s = begin; s <= end; s++) {
+                if (match_at(s, begin, end)) return true;
+            }
+            return false;
+        }
+    }
+
+    static bool search(std::string_view text) {
+        return search(text.data(), text.data() + text.size());
+    }
+};
+
+} // namespace jitregex
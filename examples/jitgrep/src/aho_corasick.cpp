@@ -0,0 +1,149 @@
+#include "matcher.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+// Full transition rows are kept for at most this many states (64 KB)
+static const uint32_t DENSE_LIMIT = 64;
+
+// Linear search below this many edges, binary search above
+static const uint32_t LINEAR_EDGES = 16;
+
+AhoCorasickMatcher::AhoCorasickMatcher(const std::vector<std::string>& needles) {
+    // Build the trie in insertion order first
+    struct TrieNode {
+        std::vector<std::pair<uint8_t, uint32_t>> kids;
+        bool out = false;
+    };
+    std::vector<TrieNode> trie(1);
+    for (const std::string& needle : needles) {
+        if (needle.find('\n') != std::string::npos) {
+            throw std::runtime_error("Fixed string contains a newline");
+        }
+        if (needle.empty()) match_all_ = true;
+        uint32_t s = 0;
+        for (unsigned char c : needle) {
+            uint32_t next = 0;
+            for (auto& kid : trie[s].kids) {
+                if (kid.first == c) {
+                    next = kid.second;
+                    break;
+                }
+            }
+            if (!next) {
+                next = (uint32_t)trie.size();
+                trie[s].kids.emplace_back(c, next);
+                trie.emplace_back();
+            }
+            s = next;
+        }
+        trie[s].out = true;
+    }
+    if (trie.size() >= MATCH) throw std::runtime_error("Too many fixed strings");
+
+    // Renumber breadth-first, so that shallow states get low numbers and
+    // every failure link points to a lower-numbered state
+    size_t n = trie.size();
+    std::vector<uint32_t> order;     // new -> old
+    std::vector<uint32_t> renum(n);  // old -> new
+    order.reserve(n);
+    order.push_back(0);
+    for (size_t i = 0; i < order.size(); i++) {
+        auto& kids = trie[order[i]].kids;
+        std::sort(kids.begin(), kids.end());
+        for (auto& kid : kids) {
+            renum[kid.second] = (uint32_t)order.size();
+            order.push_back(kid.second);
+        }
+    }
+
+    edge_begin_.resize(n + 1);
+    std::vector<bool> out(n);
+    for (size_t s = 0; s < n; s++) {
+        const TrieNode& node = trie[order[s]];
+        out[s] = node.out;
+        edge_begin_[s] = (uint32_t)edge_bytes_.size();
+        for (auto& kid : node.kids) {
+            edge_bytes_.push_back(kid.first);
+            edge_next_.push_back(renum[kid.second]);
+        }
+    }
+    edge_begin_[n] = (uint32_t)edge_bytes_.size();
+    trie.clear();
+    trie.shrink_to_fit();
+
+    // Failure links, breadth-first. A state matches if it or anything on its
+    // failure chain ends a needle; parents precede children, so one pass
+    // settles the output flags.
+    fail_.assign(n, 0);
+    dense_states_ = (uint32_t)std::min<size_t>(n, DENSE_LIMIT);
+    for (uint32_t s = 0; s < n; s++) {
+        for (uint32_t e = edge_begin_[s]; e < edge_begin_[s + 1]; e++) {
+            uint32_t kid = edge_next_[e];
+            if (s != 0) {
+                fail_[kid] = step(fail_[s], edge_bytes_[e]) & ~MATCH;
+            }
+            out[kid] = out[kid] || out[fail_[kid]];
+        }
+        // Dense rows are filled as soon as failure links of their state are
+        // known; step() above relies on them for the lower states
+        if (s < dense_states_) {
+            dense_.resize((size_t)(s + 1) * 256);
+            uint32_t* row = &dense_[(size_t)s * 256];
+            for (int c = 0; c < 256; c++) {
+                row[c] = s == 0 ? 0 : dense_[(size_t)fail_[s] * 256 + c];
+            }
+            for (uint32_t e = edge_begin_[s]; e < edge_begin_[s + 1]; e++) {
+                row[edge_bytes_[e]] = edge_next_[e];
+            }
+        }
+    }
+
+    // Tag every stored transition with its target's output flag
+    for (uint32_t& t : dense_) {
+        if (out[t]) t |= MATCH;
+    }
+    for (uint32_t& t : edge_next_) {
+        if (out[t]) t |= MATCH;
+    }
+}
+
+// The transition from `state` on `c`, with the MATCH bit of the target
+inline uint32_t AhoCorasickMatcher::step(uint32_t state, uint8_t c) const {
+    for (;;) {
+        if (state < dense_states_) return dense_[(size_t)state * 256 + c];
+
+        const uint8_t* first = edge_bytes_.data() + edge_begin_[state];
+        const uint8_t* last = edge_bytes_.data() + edge_begin_[state + 1];
+        const uint8_t* e;
+        if ((uint32_t)(last - first) < LINEAR_EDGES) {
+            for (e = first; e < last && *e < c; e++) {}
+        } else {
+            e = std::lower_bound(first, last, c);
+        }
+        if (e < last && *e == c) return edge_next_[e - edge_bytes_.data()];
+        state = fail_[state];
+    }
+}
+
+const char* AhoCorasickMatcher::find(const char* begin, const char* end) {
+    if (match_all_) return begin < end ? begin : end;
+
+    // No needle contains '\n', so the automaton is back at the root at the
+    // start of every line and can run across line boundaries
+    uint32_t state = 0;
+    for (const char* p = begin; p < end; p++) {
+        state = step(state & ~MATCH, (uint8_t)*p);
+        if (state & MATCH) return p;
+    }
+    return end;
+}
+
+void AhoCorasickMatcher::report(Stats& stats) const {
+    stats.automaton_states = fail_.size();
+    stats.automaton_size = dense_.size() * sizeof(uint32_t)
+        + fail_.size() * sizeof(uint32_t)
+        + edge_begin_.size() * sizeof(uint32_t)
+        + edge_bytes_.size() * sizeof(uint8_t)
+        + edge_next_.size() * sizeof(uint32_t);
+}
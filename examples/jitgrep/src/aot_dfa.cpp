@@ -0,0 +1,144 @@
+#include "matcher.h"
+#include "code_arena.h"
+#include "code_emitter.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+// The DFA is the lazy one, driven to completion: every state reachable from
+// the start without passing a match gets a block
+//
+//     S:  cmp rdi, rsi        ; end of input: EOL may still accept
+//         jae none / eol_tail
+//         movzx eax, byte [rdi]
+//         inc rdi
+//         <branch on al to the block of the next state, or to found>
+//
+// Most bytes of a line usually lead to one successor (back to the start,
+// or round a loop), so the branch tests the byte ranges that lead elsewhere
+// one by one, each test rarely taken and so well predicted, and then jumps
+// to that successor. States with many such ranges use a jump table.
+//
+// Transitions that accept leave at once, so states only reachable through
+// them get no code. '\n' is an ordinary byte whose transition is to the
+// start state, or to found if the line matched at EOL.
+
+// Up to this many byte ranges not leading to the most common successor are
+// tested in turn; beyond that, a state branches through a jump table
+static const size_t CHAIN_RANGES = 8;
+
+AotDfaMatcher::AotDfaMatcher(const Glushkov& g) {
+    // No flushes: the state count is checked instead
+    LazyDfa dfa(g, SIZE_MAX);
+    uint32_t start = dfa.start();
+    match_all_ = !g.nullable.empty() || !dfa.accepts(start).empty();
+
+    CompleteDfa complete;
+    if (!complete_dfa(dfa, MAX_STATES, complete)) {
+        throw std::runtime_error("pattern needs more than " + std::to_string(MAX_STATES)
+                                 + " DFA states for --engine=aot");
+    }
+    states_ = complete.next.size();
+
+    // const char* find(const char* begin, const char* end)
+    CodeEmitter emit;
+    std::vector<int> blocks(states_);
+    for (int& block : blocks) block = emit.alloc_label();
+    int none = emit.alloc_label();
+    int found = emit.alloc_label();
+    int eol_tail = emit.alloc_label();
+
+    emit.mov_r10_rdi();
+    for (size_t i = 0; i < states_; i++) {
+        // Byte ranges with the same successor, in byte order, and the
+        // successor of the most bytes
+        struct Range {
+            int first, last;
+            int target;
+        };
+        std::vector<Range> ranges;
+        std::map<int, int> bytes_to; // label -> bytes
+        for (int c = 0; c < 256; c++) {
+            uint32_t t = complete.next[i][dfa.byte_class((uint8_t)c)];
+            int target = t == CompleteDfa::MATCH ? found : blocks[t];
+            if (ranges.empty() || ranges.back().target != target) ranges.push_back({c, c, target});
+            ranges.back().last = c;
+            bytes_to[target]++;
+        }
+        int common = std::max_element(bytes_to.begin(), bytes_to.end(), [](const auto& a, const auto& b) {
+            return a.second < b.second;
+        })->first;
+        size_t others = std::count_if(ranges.begin(), ranges.end(), [&](const Range& r) { return r.target != common; });
+
+        emit.label(blocks[i]);
+        emit.cmp_rdi_rsi();
+        emit.jae(complete.eol_accepts[i] ? eol_tail : none);
+        emit.movzx_eax_ptr_rdi();
+        emit.inc_rdi();
+
+        if (others <= CHAIN_RANGES) {
+            for (const Range& r : ranges) {
+                if (r.target == common) continue;
+                if (r.first == r.last) {
+                    emit.cmp_al((uint8_t)r.first);
+                    emit.je(r.target);
+                } else {
+                    emit.lea_edx_rax_minus(r.first);
+                    emit.cmp_edx(r.last - r.first);
+                    emit.jbe(r.target);
+                }
+            }
+            emit.jmp(common);
+        } else {
+            int table = emit.alloc_label();
+            emit.lea_rdx_rip(table);
+            emit.movsxd_r8_rdx_rax4();
+            emit.lea_rdx_rdx_rax4_next();
+            emit.add_rdx_r8();
+            emit.jmp_rdx();
+            emit.label(table);
+            size_t r = 0;
+            for (int c = 0; c < 256; c++) {
+                if (c > ranges[r].last) r++;
+                emit.table_entry(ranges[r].target);
+            }
+        }
+    }
+
+    // A last line without '\n' still ends in EOL
+    emit.label(eol_tail);
+    emit.cmp_rdi_r10();
+    emit.je(none);
+    emit.cmp_ptr_rdi_prev('\n');
+    emit.je(none);
+    emit.lea_rax_rdi_prev();
+    emit.ret();
+
+    emit.label(none);
+    emit.mov_rax_rsi();
+    emit.ret();
+    emit.label(found);
+    emit.lea_rax_rdi_prev();
+    emit.ret();
+
+    code_size_ = emit.size();
+    code_ = CodeArena::instance().add(emit.get_code(), code_size_);
+}
+
+AotDfaMatcher::~AotDfaMatcher() {
+    if (code_) CodeArena::instance().release(code_, code_size_);
+}
+
+typedef const char* (*aot_func_t)(const char* begin, const char* end);
+
+const char* AotDfaMatcher::find(const char* begin, const char* end) {
+    if (match_all_) return begin;
+    return reinterpret_cast<aot_func_t>(code_)(begin, end);
+}
+
+void AotDfaMatcher::report(Stats& stats) const {
+    stats.code_size = code_size_;
+    stats.automaton_states = states_;
+}
@@ -0,0 +1,221 @@
+#include "matcher.h"
+#include "code_arena.h"
+#include "code_emitter.h"
+
+// The state D is a bitmask of live positions, numbered in pattern order.
+// One step on byte c computes
+//
+//     D' = (((D << 1) & SHIFT) | EXCEPT(D) | FIRST) & B[c]
+//
+// SHIFT holds the positions entered from their left neighbour, which is
+// every concatenation; EXCEPT(D) ors in the remaining follow sets (loops of
+// stars, joins of alternatives) of the positions in D; FIRST restarts the
+// pattern at every byte. '\n' steps on the EOL sentinel, tests for a match
+// and resets D to its value after BOL.
+
+// Layout of tables_, in 64-bit words
+enum : int32_t {
+    T_BYTES = 0,  // B[c]: positions entered on c ('\n' enters EOL positions)
+    T_SHIFT = 256,
+    T_FIRST,
+    T_LAST,       // positions that end a match
+    T_BOL,        // state at the start of a line
+    T_EXCEPT      // per-position follow sets, or 256-entry tables per byte of D
+};
+
+// Up to this many exception positions are tested one by one; beyond that,
+// each byte of D that has any looks its follow sets up in a table
+static const size_t EXCEPT_INLINE = 4;
+
+static int32_t word(int32_t index) {
+    return index * 8;
+}
+
+BitNfaMatcher::BitNfaMatcher(const Glushkov& g) {
+    size_t n = g.symbol.size();
+    positions_ = n;
+    auto bit = [](uint32_t p) { return uint64_t(1) << p; };
+
+    tables_.assign(T_EXCEPT, 0);
+    uint64_t bol = 0, eol = 0;
+    for (uint32_t p = 0; p < n; p++) {
+        uint16_t sym = g.symbol[p];
+        if (sym == SYM_BOL) {
+            bol |= bit(p);
+        } else if (sym == SYM_EOL) {
+            eol |= bit(p);
+        } else {
+            for (int c = 0; c < 256; c++) {
+                if (c != '\n' && g.matches(p, c)) tables_[T_BYTES + c] |= bit(p);
+            }
+        }
+        if (g.last[p]) tables_[T_LAST] |= bit(p);
+    }
+    tables_[T_BYTES + '\n'] = eol;
+    for (uint32_t p : g.first) tables_[T_FIRST] |= bit(p);
+
+    // Split each follow set into the shift and the exceptions
+    std::vector<uint32_t> except;
+    std::vector<uint64_t> follow(n, 0);
+    for (uint32_t p = 0; p < n; p++) {
+        bool irregular = false;
+        for (uint32_t q : g.follow[p]) {
+            follow[p] |= bit(q);
+            if (q == p + 1) {
+                tables_[T_SHIFT] |= bit(q);
+            } else {
+                irregular = true;
+            }
+        }
+        if (irregular) except.push_back(p);
+    }
+    auto follow_of = [&](uint64_t d) {
+        uint64_t f = 0;
+        for (uint32_t p = 0; p < n; p++) {
+            if (d & bit(p)) f |= follow[p];
+        }
+        return f;
+    };
+
+    // The start of a line: BOL positions, and those chained after them (^^)
+    uint64_t d = tables_[T_FIRST] & bol, prev;
+    do {
+        prev = d;
+        d |= follow_of(d) & bol;
+    } while (d != prev);
+    tables_[T_BOL] = d;
+
+    match_all_ = !g.nullable.empty() || (d & tables_[T_LAST]);
+
+    // $$ needs one EOL step per anchor in the chain
+    int eol_steps = 1;
+    for (uint32_t p = 0; p < n; p++) {
+        if ((eol & bit(p)) && (follow[p] & eol)) eol_steps++;
+    }
+
+    // Exception tables
+    bool inline_except = except.size() <= EXCEPT_INLINE;
+    std::vector<std::pair<int, int32_t>> chunks; // (byte of D, table offset)
+    if (inline_except) {
+        for (uint32_t p : except) tables_.push_back(follow[p]);
+    } else {
+        for (int j = 0; j < 8; j++) {
+            uint64_t mask = 0;
+            for (uint32_t p : except) {
+                if (p / 8 == (uint32_t)j) mask |= bit(p);
+            }
+            if (!mask) continue;
+            chunks.emplace_back(j, (int32_t)tables_.size());
+            for (int v = 0; v < 256; v++) {
+                tables_.push_back(follow_of((uint64_t(v) << (8 * j)) & mask));
+            }
+        }
+    }
+
+    // const char* find(const char* begin, const char* end, const uint64_t* tables)
+    CodeEmitter emit;
+    auto step = [&]() {
+        emit.mov_r8_rcx();
+        emit.shl_r8_1();
+        emit.and_r8_r9(word(T_SHIFT));
+        emit.or_r8_r9(word(T_FIRST));
+        if (inline_except) {
+            for (size_t k = 0; k < except.size(); k++) {
+                emit.mov_rdx_rcx();
+                if (except[k]) emit.shr_rdx((uint8_t)except[k]);
+                emit.and_edx_1();
+                emit.neg_rdx();
+                emit.and_rdx_r9(word(T_EXCEPT + (int32_t)k));
+                emit.or_r8_rdx();
+            }
+        } else {
+            for (auto& chunk : chunks) {
+                emit.mov_rdx_rcx();
+                if (chunk.first) emit.shr_rdx((uint8_t)(8 * chunk.first));
+                emit.movzx_edx_dl();
+                emit.or_r8_r9_rdx8(word(chunk.second));
+            }
+        }
+        emit.and_r8_r9_rax8();
+        emit.mov_rcx_r8();
+    };
+
+    int loop = emit.alloc_label();
+    int newline = emit.alloc_label();
+    int at_end = emit.alloc_label();
+    int none = emit.alloc_label();
+    int found = emit.alloc_label();
+    int found_prev = emit.alloc_label();
+
+    emit.mov_r9_rdx();
+    emit.mov_r10_rdi();
+    emit.mov_rcx_r9(word(T_BOL));
+    emit.cmp_rdi_rsi();
+    emit.jae(at_end);
+
+    emit.label(loop);
+    emit.movzx_eax_ptr_rdi();
+    emit.cmp_al('\n');
+    emit.je(newline);
+    step();
+    emit.test_rcx_r9(word(T_LAST));
+    emit.jnz(found);
+    emit.inc_rdi();
+    emit.cmp_rdi_rsi();
+    emit.jb(loop);
+    emit.jmp(at_end);
+
+    emit.label(newline);
+    for (int i = 0; i < eol_steps; i++) {
+        step();
+        emit.test_rcx_r9(word(T_LAST));
+        emit.jnz(found);
+    }
+    emit.mov_rcx_r9(word(T_BOL));
+    emit.inc_rdi();
+    emit.cmp_rdi_rsi();
+    emit.jb(loop);
+
+    // A last line without '\n' still ends in EOL
+    emit.label(at_end);
+    emit.cmp_rdi_r10();
+    emit.je(none);
+    emit.cmp_ptr_rdi_prev('\n');
+    emit.je(none);
+    emit.mov_eax('\n');
+    for (int i = 0; i < eol_steps; i++) {
+        step();
+        emit.test_rcx_r9(word(T_LAST));
+        emit.jnz(found_prev);
+    }
+
+    emit.label(none);
+    emit.mov_rax_rsi();
+    emit.ret();
+    emit.label(found);
+    emit.mov_rax_rdi();
+    emit.ret();
+    emit.label(found_prev);
+    emit.lea_rax_rdi_prev();
+    emit.ret();
+
+    code_size_ = emit.size();
+    code_ = CodeArena::instance().add(emit.get_code(), code_size_);
+}
+
+BitNfaMatcher::~BitNfaMatcher() {
+    if (code_) CodeArena::instance().release(code_, code_size_);
+}
+
+typedef const char* (*nfa_func_t)(const char* begin, const char* end, const uint64_t* tables);
+
+const char* BitNfaMatcher::find(const char* begin, const char* end) {
+    if (match_all_) return begin;
+    return reinterpret_cast<nfa_func_t>(code_)(begin, end, tables_.data());
+}
+
+void BitNfaMatcher::report(Stats& stats) const {
+    stats.code_size = code_size_;
+    stats.automaton_states = positions_;
+    stats.automaton_size = tables_.size() * sizeof(uint64_t);
+}
@@ -0,0 +1,159 @@
+#include "code_arena.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Functions start on a cache-line-friendly boundary
+static const size_t CODE_ALIGN = 16;
+
+static size_t page_size() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+static size_t round_up(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+CodeArena& CodeArena::instance() {
+    static CodeArena arena;
+    return arena;
+}
+
+CodeArena::~CodeArena() {
+    for (auto& c : chunks_) munmap(c.first, c.second.size);
+}
+
+// The batch open on this thread, if any
+static thread_local CodeArena::Batch* open_batch = nullptr;
+
+// Map a writable chunk; a huge one is aligned to CHUNK_SIZE, so that it can
+// be backed by huge pages
+char* CodeArena::map_chunk(size_t size, bool huge) {
+    size_t span = huge ? size + CHUNK_SIZE : size;
+    void* p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    syscalls_++;
+    if (p == MAP_FAILED) {
+        throw std::runtime_error(std::string("Cannot map code memory: ") + strerror(errno));
+    }
+
+    char* base = static_cast<char*>(p);
+    if (huge) {
+        // Trim the unaligned head and the tail
+        char* raw = base;
+        base = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(raw), CHUNK_SIZE));
+        if (base > raw) {
+            munmap(raw, base - raw);
+            syscalls_++;
+        }
+        if (raw + span > base + size) {
+            munmap(base + size, raw + span - (base + size));
+            syscalls_++;
+        }
+        madvise(base, size, MADV_HUGEPAGE);
+        syscalls_++;
+    }
+
+    Chunk chunk;
+    chunk.size = size;
+    chunks_.emplace(base, chunk);
+    return base;
+}
+
+void CodeArena::unmap_chunk(char* base) {
+    auto it = chunks_.find(base);
+    munmap(base, it->second.size);
+    syscalls_++;
+    chunks_.erase(it);
+}
+
+void* CodeArena::add(const void* code, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Batch* batch = open_batch && &open_batch->arena_ == this ? open_batch : nullptr;
+    if (!batch) {
+        char* base = map_chunk(round_up(size, page_size()), false);
+        memcpy(base, code, size);
+        Chunk& chunk = chunks_.at(base);
+        chunk.used = chunk.live = size;
+        seal(base);
+        return base;
+    }
+
+    char* base = batch->chunks_.empty() ? nullptr : batch->chunks_.back();
+    Chunk* chunk = base ? &chunks_.at(base) : nullptr;
+    size_t offset = chunk ? round_up(chunk->used, CODE_ALIGN) : 0;
+    if (!chunk || offset + size > chunk->size) {
+        base = map_chunk(std::max(CHUNK_SIZE, round_up(size, CHUNK_SIZE)), true);
+        batch->chunks_.push_back(base);
+        chunk = &chunks_.at(base);
+        offset = 0;
+    }
+
+    char* dst = base + offset;
+    memcpy(dst, code, size);
+    chunk->used = offset + size;
+    chunk->live += size;
+    return dst;
+}
+
+// Make a chunk executable, whole, so its mapping stays in one piece. A
+// chunk less than half used first gives back its untouched tail.
+void CodeArena::seal(char* base) {
+    Chunk& c = chunks_.at(base);
+    size_t end = round_up(c.used, page_size());
+    if (end < c.size / 2) {
+        munmap(base + end, c.size - end);
+        syscalls_++;
+        c.size = end;
+    }
+    if (mprotect(base, c.size, PROT_READ | PROT_EXEC) != 0) {
+        // Code already handed out could never run
+        perror("mprotect");
+        abort();
+    }
+    syscalls_++;
+    c.sealed = true;
+
+    // Everything in it was released before it was even sealed
+    if (c.live == 0) unmap_chunk(base);
+}
+
+void CodeArena::release(const void* code, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = chunks_.upper_bound(const_cast<char*>(static_cast<const char*>(code)));
+    if (it == chunks_.begin()) return;
+    --it;
+    Chunk& c = it->second;
+    c.live -= size;
+
+    // A batch still filling the chunk seals it later
+    if (c.live == 0 && c.sealed) unmap_chunk(it->first);
+}
+
+CodeArena::Batch::Batch(CodeArena& arena) : arena_(arena), outer_(open_batch) {
+    if (!outer_) open_batch = this;
+}
+
+CodeArena::Batch::~Batch() {
+    if (outer_) return;
+    open_batch = nullptr;
+    std::lock_guard<std::mutex> lock(arena_.mutex_);
+    for (char* base : chunks_) arena_.seal(base);
+}
+
+size_t CodeArena::chunk_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunks_.size();
+}
+
+uint64_t CodeArena::syscalls() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syscalls_;
+}
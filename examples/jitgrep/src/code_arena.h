@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Executable memory shared by all JIT instances. Code compiled inside a
+// Batch is packed into 2 MB chunks (backed by transparent huge pages where
+// the kernel allows), so thousands of small patterns share a few i-TLB
+// entries instead of owning a page and a mapping each.
+//
+// Memory is never writable and executable at once: code is copied into
+// writable pages, and sealing flips a whole chunk to read+execute with one
+// mprotect, so the mapping is never split and a huge page stays whole. A
+// sealed chunk takes no more code. A Batch seals its chunks when it ends,
+// so compiling many patterns in a row costs a handful of syscalls; code
+// added outside one gets a chunk of its own pages, sealed at once. Batches
+// belong to the thread that opened them. A chunk is unmapped once all its
+// code is released.
+class CodeArena {
+public:
+    static const size_t CHUNK_SIZE = 2 << 20;
+
+    // The arena used by JIT
+    static CodeArena& instance();
+
+    CodeArena() = default;
+    ~CodeArena();
+    CodeArena(const CodeArena&) = delete;
+    CodeArena& operator=(const CodeArena&) = delete;
+
+    // Copy position-independent code into the arena and return its address.
+    // The code may run once this thread's outermost Batch ends, or right
+    // away if it has none open.
+    void* add(const void* code, size_t size);
+
+    // Give back code returned by add()
+    void release(const void* code, size_t size);
+
+    // Packs everything this thread adds while it lives into shared chunks,
+    // and seals them at the end. Nested batches join the outermost one.
+    class Batch {
+    public:
+        explicit Batch(CodeArena& arena = CodeArena::instance());
+        ~Batch();
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+    private:
+        friend class CodeArena;
+        CodeArena& arena_;
+        Batch* outer_;              // the thread's batch this one joins, if any
+        std::vector<char*> chunks_; // filled by this batch; the last takes new code
+    };
+
+    size_t chunk_count();
+    uint64_t syscalls(); // mmap, munmap, madvise and mprotect calls so far
+
+private:
+    struct Chunk {
+        size_t size;
+        size_t used = 0; // bytes handed out, from the start
+        size_t live = 0; // bytes handed out and not released
+        bool sealed = false;
+    };
+
+    char* map_chunk(size_t size, bool huge);
+    void unmap_chunk(char* base);
+    void seal(char* base);
+
+    std::mutex mutex_;
+    std::map<char*, Chunk> chunks_; // by base address
+    uint64_t syscalls_ = 0;
+};
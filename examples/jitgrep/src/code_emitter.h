@@ -0,0 +1,280 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "jit.h"
+
+// Simple x64 Assembler helper
+class CodeEmitter {
+    std::vector<uint8_t> code;
+    // Map from label_id to list of locations that point to it (patch sites)
+    std::map<int, std::vector<size_t>> label_patches;
+    // Map from label_id to resolved definition location
+    std::map<int, size_t> label_defs;
+    int next_label_id = 1;
+
+public:
+    // Assembly listing, kept only when enabled
+    bool keep_listing = false;
+    std::vector<AsmLine> listing;
+
+    // Record the instruction about to be emitted; `fmt` may take one argument
+    void note(const char* fmt, uint64_t arg = 0) {
+        if (!keep_listing) return;
+        char text[64];
+        snprintf(text, sizeof(text), fmt, (unsigned long long)arg);
+        listing.push_back({code.size(), text});
+    }
+
+    void* get_code() {
+        return code.data();
+    }
+    
+    size_t size() { return code.size(); }
+
+    int alloc_label() { return next_label_id++; }
+
+    void emit_byte(uint8_t b) {
+        code.push_back(b);
+    }
+    
+    void emit_bytes(const std::vector<uint8_t>& bytes) {
+        code.insert(code.end(), bytes.begin(), bytes.end());
+    }
+    
+    void emit_u32(uint32_t val) {
+        code.push_back(val & 0xFF);
+        code.push_back((val >> 8) & 0xFF);
+        code.push_back((val >> 16) & 0xFF);
+        code.push_back((val >> 24) & 0xFF);
+    }
+
+    void emit_u64(uint64_t val) {
+        emit_u32((uint32_t)val);
+        emit_u32((uint32_t)(val >> 32));
+    }
+
+    // Call definition of a label (current location)
+    void label(int id) {
+        note("L%llu:", id);
+        label_defs[id] = code.size();
+        if (label_patches.count(id)) {
+            for (size_t loc : label_patches[id]) {
+                // Calculate relative offset
+                // rel32 = target - (loc + 4)
+                int32_t rel = (int32_t)(code.size() - (loc + 4));
+                // Patch
+                code[loc] = rel & 0xFF;
+                code[loc+1] = (rel >> 8) & 0xFF;
+                code[loc+2] = (rel >> 16) & 0xFF;
+                code[loc+3] = (rel >> 24) & 0xFF;
+            }
+            label_patches.erase(id);
+        }
+    }
+
+    // Emit JMP/Jcc to label (32-bit relative)
+    // Opcode is the byte(s) for the jump instruction before the immediate
+    void emit_jump(std::vector<uint8_t> opcode, int target_label) {
+        emit_bytes(opcode);
+        size_t patch_loc = code.size();
+        emit_u32(0); // placeholder
+        
+        if (label_defs.count(target_label)) {
+            // Already defined
+            int32_t rel = (int32_t)(label_defs[target_label] - (patch_loc + 4));
+            code[patch_loc] = rel & 0xFF;
+            code[patch_loc+1] = (rel >> 8) & 0xFF;
+            code[patch_loc+2] = (rel >> 16) & 0xFF;
+            code[patch_loc+3] = (rel >> 24) & 0xFF;
+        } else {
+            label_patches[target_label].push_back(patch_loc);
+        }
+    }
+
+    // LEA rax, [rip + label]
+    void emit_lea_rip(int target_label) {
+        note("lea rax, [rip + L%llu]", target_label);
+        // 48 8D 05 xx xx xx xx
+        emit_bytes({0x48, 0x8D, 0x05});
+        size_t patch_loc = code.size();
+        emit_u32(0);
+
+        if (label_defs.count(target_label)) {
+             int32_t rel = (int32_t)(label_defs[target_label] - (patch_loc + 4));
+             // patch logic (extracted)
+             code[patch_loc] = rel & 0xFF;
+             code[patch_loc+1] = (rel >> 8) & 0xFF;
+             code[patch_loc+2] = (rel >> 16) & 0xFF;
+             code[patch_loc+3] = (rel >> 24) & 0xFF;
+        } else {
+            label_patches[target_label].push_back(patch_loc);
+        }
+    }
+
+    // --- Instructions ---
+
+    void push_rdi() { note("push rdi"); emit_byte(0x57); }
+    void pop_rdi() { note("pop rdi"); emit_byte(0x5F); }
+    void push_rax() { note("push rax"); emit_byte(0x50); }
+    void push_rbp() { note("push rbp"); emit_byte(0x55); }
+    void pop_rbp() { note("pop rbp"); emit_byte(0x5D); }
+    void ret() { note("ret"); emit_byte(0xC3); }
+    
+    // mov rsp, rbp
+    void mov_rsp_rbp() { note("mov rsp, rbp"); emit_bytes({0x48, 0x89, 0xEC}); }
+    
+    // mov rbp, rsp
+    void mov_rbp_rsp() { note("mov rbp, rsp"); emit_bytes({0x48, 0x89, 0xE5}); }
+
+    // mov rax, imm64 (simplified to imm32 for 0/1)
+    void mov_rax_0() { note("mov rax, 0"); emit_bytes({0x48, 0xC7, 0xC0, 0x00, 0x00, 0x00, 0x00}); }
+    void mov_rax_1() { note("mov rax, 1"); emit_bytes({0x48, 0xC7, 0xC0, 0x01, 0x00, 0x00, 0x00}); }
+    // inc rdi
+    void inc_rdi() { note("inc rdi"); emit_bytes({0x48, 0xFF, 0xC7}); }
+
+    // mov al, [rdi]
+    void mov_al_ptr_rdi() { note("mov al, [rdi]"); emit_bytes({0x8A, 0x07}); }
+
+    // cmp al, imm8
+    void cmp_al(uint8_t val) { note("cmp al, 0x%02llx", val); emit_bytes({0x3C, val}); }
+    
+    // cmp byte ptr [rdi], imm8
+    void cmp_ptr_rdi(uint8_t val) { note("cmp byte ptr [rdi], 0x%02llx", val); emit_bytes({0x80, 0x3F, val}); }
+
+    // je label
+    void je(int label) { note("je L%llu", label); emit_jump({0x0F, 0x84}, label); }
+    
+    // jne label
+    void jne(int label) { note("jne L%llu", label); emit_jump({0x0F, 0x85}, label); }
+
+    // jae label
+    void jae(int label) { note("jae L%llu", label); emit_jump({0x0F, 0x83}, label); }
+    
+    // jmp label
+    void jmp(int label) { note("jmp L%llu", label); emit_jump({0xE9}, label); }
+    
+    // cmp rdi, rsi (compare pointers)
+    void cmp_rdi_rsi() { note("cmp rdi, rsi"); emit_bytes({0x48, 0x39, 0xF7}); }
+
+    // cmp rdi, rdx (compare against the end of input)
+    void cmp_rdi_rdx() { note("cmp rdi, rdx"); emit_bytes({0x48, 0x39, 0xD7}); }
+
+    // mov r11, imm64 (r11 is caller-saved scratch)
+    void mov_r11_imm64(uint64_t val) { note("mov r11, 0x%llx", val); emit_bytes({0x49, 0xBB}); emit_u64(val); }
+
+    // inc qword ptr [r11]
+    void inc_ptr_r11() { note("inc qword ptr [r11]"); emit_bytes({0x49, 0xFF, 0x03}); }
+
+    // --- Mark slots of the backtracking JIT, at negative offsets from rbp ---
+
+    // sub rsp, imm32
+    void sub_rsp(uint32_t val) { note("sub rsp, %llu", val); emit_bytes({0x48, 0x81, 0xEC}); emit_u32(val); }
+    // mov [rbp + disp32], rdi
+    void mov_slot_rdi(int32_t disp) { note("mov [rbp - %llu], rdi", -disp); emit_bytes({0x48, 0x89, 0xBD}); emit_u32((uint32_t)disp); }
+    // push qword ptr [rbp + disp32]
+    void push_slot(int32_t disp) { note("push qword ptr [rbp - %llu]", -disp); emit_bytes({0xFF, 0xB5}); emit_u32((uint32_t)disp); }
+    // cmp rdi, [rbp + disp32]
+    void cmp_rdi_slot(int32_t disp) { note("cmp rdi, [rbp - %llu]", -disp); emit_bytes({0x48, 0x3B, 0xBD}); emit_u32((uint32_t)disp); }
+    // mov [rbp + disp32], rsp
+    void mov_slot_rsp(int32_t disp) { note("mov [rbp - %llu], rsp", -disp); emit_bytes({0x48, 0x89, 0xA5}); emit_u32((uint32_t)disp); }
+    // mov rsp, [rbp + disp32]
+    void mov_rsp_slot(int32_t disp) { note("mov rsp, [rbp - %llu]", -disp); emit_bytes({0x48, 0x8B, 0xA5}); emit_u32((uint32_t)disp); }
+    // mov [rbp + disp32], rax
+    void mov_slot_rax(int32_t disp) { note("mov [rbp - %llu], rax", -disp); emit_bytes({0x48, 0x89, 0x85}); emit_u32((uint32_t)disp); }
+    // mov rax, [rbp + disp32]
+    void mov_rax_slot(int32_t disp) { note("mov rax, [rbp - %llu]", -disp); emit_bytes({0x48, 0x8B, 0x85}); emit_u32((uint32_t)disp); }
+
+    // --- Captures of the backtracking JIT, stored through rcx ---
+
+    // mov [rcx + disp32], rdi
+    void mov_rcx_ptr_rdi(int32_t disp) { note("mov [rcx + %llu], rdi", disp); emit_bytes({0x48, 0x89, 0xB9}); emit_u32((uint32_t)disp); }
+    // mov [rcx + disp32], rax
+    void mov_rcx_ptr_rax(int32_t disp) { note("mov [rcx + %llu], rax", disp); emit_bytes({0x48, 0x89, 0x81}); emit_u32((uint32_t)disp); }
+
+    // --- Bit-parallel NFA (bitnfa.cpp) ---
+    // Register use there: rdi position, rsi end, r9 tables, r10 start of
+    // input, rcx state, r8 next state, rax current byte, rdx scratch.
+
+    void emit_disp32(int32_t disp) { emit_u32((uint32_t)disp); }
+
+    // mov r9, rdx
+    void mov_r9_rdx() { note("mov r9, rdx"); emit_bytes({0x49, 0x89, 0xD1}); }
+    // mov r10, rdi
+    void mov_r10_rdi() { note("mov r10, rdi"); emit_bytes({0x49, 0x89, 0xFA}); }
+    // mov rcx, [r9 + disp32]
+    void mov_rcx_r9(int32_t disp) { note("mov rcx, [r9 + %llu]", disp); emit_bytes({0x49, 0x8B, 0x89}); emit_disp32(disp); }
+    // movzx eax, byte ptr [rdi]
+    void movzx_eax_ptr_rdi() { note("movzx eax, byte ptr [rdi]"); emit_bytes({0x0F, 0xB6, 0x07}); }
+    // mov eax, imm32
+    void mov_eax(uint32_t val) { note("mov eax, 0x%llx", val); emit_byte(0xB8); emit_u32(val); }
+    // mov r8, rcx
+    void mov_r8_rcx() { note("mov r8, rcx"); emit_bytes({0x49, 0x89, 0xC8}); }
+    // shl r8, 1
+    void shl_r8_1() { note("shl r8, 1"); emit_bytes({0x49, 0xD1, 0xE0}); }
+    // and r8, [r9 + disp32]
+    void and_r8_r9(int32_t disp) { note("and r8, [r9 + %llu]", disp); emit_bytes({0x4D, 0x23, 0x81}); emit_disp32(disp); }
+    // or r8, [r9 + disp32]
+    void or_r8_r9(int32_t disp) { note("or r8, [r9 + %llu]", disp); emit_bytes({0x4D, 0x0B, 0x81}); emit_disp32(disp); }
+    // and r8, [r9 + rax*8]
+    void and_r8_r9_rax8() { note("and r8, [r9 + rax*8]"); emit_bytes({0x4D, 0x23, 0x04, 0xC1}); }
+    // or r8, [r9 + rdx*8 + disp32]
+    void or_r8_r9_rdx8(int32_t disp) { note("or r8, [r9 + rdx*8 + %llu]", disp); emit_bytes({0x4D, 0x0B, 0x84, 0xD1}); emit_disp32(disp); }
+    // mov rdx, rcx
+    void mov_rdx_rcx() { note("mov rdx, rcx"); emit_bytes({0x48, 0x89, 0xCA}); }
+    // shr rdx, imm8
+    void shr_rdx(uint8_t n) { note("shr rdx, %llu", n); emit_bytes({0x48, 0xC1, 0xEA, n}); }
+    // and edx, 1
+    void and_edx_1() { note("and edx, 1"); emit_bytes({0x83, 0xE2, 0x01}); }
+    // neg rdx
+    void neg_rdx() { note("neg rdx"); emit_bytes({0x48, 0xF7, 0xDA}); }
+    // and rdx, [r9 + disp32]
+    void and_rdx_r9(int32_t disp) { note("and rdx, [r9 + %llu]", disp); emit_bytes({0x49, 0x23, 0x91}); emit_disp32(disp); }
+    // movzx edx, dl
+    void movzx_edx_dl() { note("movzx edx, dl"); emit_bytes({0x0F, 0xB6, 0xD2}); }
+    // or r8, rdx
+    void or_r8_rdx() { note("or r8, rdx"); emit_bytes({0x49, 0x09, 0xD0}); }
+    // mov rcx, r8
+    void mov_rcx_r8() { note("mov rcx, r8"); emit_bytes({0x4C, 0x89, 0xC1}); }
+    // test rcx, [r9 + disp32]
+    void test_rcx_r9(int32_t disp) { note("test rcx, [r9 + %llu]", disp); emit_bytes({0x49, 0x85, 0x89}); emit_disp32(disp); }
+    // cmp rdi, r10
+    void cmp_rdi_r10() { note("cmp rdi, r10"); emit_bytes({0x4C, 0x39, 0xD7}); }
+    // cmp byte ptr [rdi - 1], imm8
+    void cmp_ptr_rdi_prev(uint8_t val) { note("cmp byte ptr [rdi - 1], 0x%02llx", val); emit_bytes({0x80, 0x7F, 0xFF, val}); }
+    // jb label
+    void jb(int label) { note("jb L%llu", label); emit_jump({0x0F, 0x82}, label); }
+    // jnz label (alias of jne, reads better after test)
+    void jnz(int label) { note("jnz L%llu", label); emit_jump({0x0F, 0x85}, label); }
+    // mov rax, rdi
+    void mov_rax_rdi() { note("mov rax, rdi"); emit_bytes({0x48, 0x89, 0xF8}); }
+    // mov rax, rsi
+    void mov_rax_rsi() { note("mov rax, rsi"); emit_bytes({0x48, 0x89, 0xF0}); }
+    // lea rax, [rdi - 1]
+    void lea_rax_rdi_prev() { note("lea rax, [rdi - 1]"); emit_bytes({0x48, 0x8D, 0x47, 0xFF}); }
+
+    // --- Ahead-of-time DFA (aot_dfa.cpp) ---
+    // Same registers as the NFA for position, end, start of input and the
+    // current byte; rdx and r8 hold jump table addresses.
+
+    // lea edx, [rax - imm32]
+    void lea_edx_rax_minus(uint32_t val) { note("lea edx, [rax - %llu]", val); emit_bytes({0x8D, 0x90}); emit_u32(-val); }
+    // cmp edx, imm32
+    void cmp_edx(uint32_t val) { note("cmp edx, %llu", val); emit_bytes({0x81, 0xFA}); emit_u32(val); }
+    // jbe label
+    void jbe(int label) { note("jbe L%llu", label); emit_jump({0x0F, 0x86}, label); }
+    // lea rdx, [rip + label]
+    void lea_rdx_rip(int label) { note("lea rdx, [rip + L%llu]", label); emit_jump({0x48, 0x8D, 0x15}, label); }
+    // movsxd r8, dword ptr [rdx + rax*4]
+    void movsxd_r8_rdx_rax4() { note("movsxd r8, dword ptr [rdx + rax*4]"); emit_bytes({0x4C, 0x63, 0x04, 0x82}); }
+    // lea rdx, [rdx + rax*4 + 4]
+    void lea_rdx_rdx_rax4_next() { note("lea rdx, [rdx + rax*4 + 4]"); emit_bytes({0x48, 0x8D, 0x54, 0x82, 0x04}); }
+    // add rdx, r8
+    void add_rdx_r8() { note("add rdx, r8"); emit_bytes({0x4C, 0x01, 0xC2}); }
+    // jmp rdx
+    void jmp_rdx() { note("jmp rdx"); emit_bytes({0xFF, 0xE2}); }
+    // Jump table entry: the offset of `label` from the end of the entry
+    void table_entry(int label) { note("dd L%llu", label); emit_jump({}, label); }
+};
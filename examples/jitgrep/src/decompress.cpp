@@ -0,0 +1,1063 @@
+#include "decompress.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static void corrupt(const char* what) {
+    throw std::runtime_error(std::string("corrupt input: ") + what);
+}
+
+static int highest_bit(uint32_t x) { return 31 - __builtin_clz(x); }
+
+static uint32_t le16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static uint32_t le32(const uint8_t* p) { return le16(p) | (le16(p + 2) << 16); }
+
+// Buffered reads from a file descriptor: the decoders' compressed input
+class FdInput {
+public:
+    explicit FdInput(int fd) : fd_(fd), buf_(1 << 18) {}
+
+    // Make at least `n` bytes available (fewer only at end of input).
+    // Returns the number available.
+    size_t peek(size_t n) {
+        if (len_ - pos_ >= n) return len_ - pos_;
+        memmove(buf_.data(), buf_.data() + pos_, len_ - pos_);
+        len_ -= pos_;
+        pos_ = 0;
+        while (len_ < n) {
+            size_t got = read_fd(buf_.data() + len_, buf_.size() - len_);
+            if (got == 0) break;
+            len_ += got;
+        }
+        return len_;
+    }
+
+    const uint8_t* data() const { return buf_.data() + pos_; }
+    size_t buffered() const { return len_ - pos_; }
+
+    void skip(size_t n) { pos_ += n; }
+
+    // Next byte, or -1 at end of input
+    int get() {
+        if (pos_ == len_) {
+            pos_ = 0;
+            len_ = read_fd(buf_.data(), buf_.size());
+            if (len_ == 0) return -1;
+        }
+        return buf_[pos_++];
+    }
+
+    void read_exact(uint8_t* dst, size_t n) {
+        while (n > 0) {
+            if (pos_ == len_) {
+                pos_ = 0;
+                len_ = read_fd(buf_.data(), buf_.size());
+                if (len_ == 0) corrupt("unexpected end of compressed stream");
+            }
+            size_t k = std::min(n, len_ - pos_);
+            memcpy(dst, buf_.data() + pos_, k);
+            pos_ += k;
+            dst += k;
+            n -= k;
+        }
+    }
+
+    // Buffered bytes first, then straight from the descriptor
+    size_t read_through(char* dst, size_t cap) {
+        if (pos_ < len_) {
+            size_t k = std::min(cap, len_ - pos_);
+            memcpy(dst, buf_.data() + pos_, k);
+            pos_ += k;
+            return k;
+        }
+        return read_fd(dst, cap);
+    }
+
+    bool ready() {
+        if (pos_ < len_) return true;
+        pollfd p = {fd_, POLLIN, 0};
+        return poll(&p, 1, 0) > 0;
+    }
+
+private:
+    size_t read_fd(void* dst, size_t cap) {
+        for (;;) {
+            ssize_t n = ::read(fd_, dst, cap);
+            if (n >= 0) return n;
+            if (errno != EINTR) throw std::runtime_error(std::string("read: ") + strerror(errno));
+        }
+    }
+
+    int fd_;
+    std::vector<uint8_t> buf_;
+    size_t pos_ = 0;
+    size_t len_ = 0;
+};
+
+// Decoded output, preceded by the history that back-references reach into.
+// Output is appended at `pos` and handed out from `delivered`; when space
+// runs out the last `history` bytes slide to the front.
+//
+// drain() copies output into the reader's Buffer rather than decoding into
+// it: back-references reach up to `history` bytes back (32 KB for gzip, up
+// to the frame's window for zstd), into output the matcher may already
+// have handed back, so a window has to outlive the buffers either way.
+// Decoding in place would still copy that history after every read, which
+// for large zstd windows is more than the output. The copy runs on the
+// reader thread and costs about 1% of inflate time.
+struct Window {
+    std::vector<uint8_t> buf;
+    size_t history;
+    size_t pos = 0;
+    size_t delivered = 0;
+
+    Window(size_t history, size_t chunk) : buf(history + chunk), history(history) {}
+
+    bool pending() const { return delivered < pos; }
+    size_t space() const { return buf.size() - pos; }
+
+    // Room for `n` more bytes. Only called once everything is delivered.
+    void reserve(size_t n) {
+        if (space() >= n) return;
+        size_t keep = std::min(pos, history);
+        memmove(buf.data(), buf.data() + pos - keep, keep);
+        pos = delivered = keep;
+    }
+
+    // Copy out up to `cap` bytes of output not yet handed out
+    size_t drain(char* dst, size_t cap) {
+        size_t n = std::min(cap, pos - delivered);
+        memcpy(dst, buf.data() + delivered, n);
+        delivered += n;
+        return n;
+    }
+
+    void append(const uint8_t* src, size_t n) {
+        if (n > space()) corrupt("block larger than declared");
+        memcpy(buf.data() + pos, src, n);
+        pos += n;
+    }
+
+    // Copy `len` bytes from `dist` back; source and destination may overlap
+    void copy_match(size_t dist, size_t len) {
+        if (dist == 0 || dist > pos) corrupt("match distance too far back");
+        if (len > space()) corrupt("block larger than declared");
+        uint8_t* d = buf.data() + pos;
+        const uint8_t* s = d - dist;
+        if (dist >= len) {
+            memcpy(d, s, len);
+        } else {
+            for (size_t i = 0; i < len; i++) d[i] = s[i];
+        }
+        pos += len;
+    }
+};
+
+class PlainSource : public Source {
+public:
+    explicit PlainSource(std::unique_ptr<FdInput> in) : in_(std::move(in)) {}
+    size_t read(char* dst, size_t cap) override { return in_->read_through(dst, cap); }
+    bool ready() override { return in_->ready(); }
+
+private:
+    std::unique_ptr<FdInput> in_;
+};
+
+// --- gzip (RFC 1951/1952) ---
+
+static const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                         35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                         2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                       193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                       6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                       6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5,
+                                              11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Canonical Huffman decoding table indexed by the next `bits` input bits
+// (LSB first). Entries are symbol << 4 | code length; 0 marks an unused code.
+struct Huffman {
+    std::vector<uint16_t> table;
+    int bits = 0;
+
+    void build(const uint8_t* lengths, int n) {
+        int count[16] = {0};
+        for (int i = 0; i < n; i++) count[lengths[i]]++;
+        count[0] = 0;
+        bits = 0;
+        for (int l = 1; l < 16; l++) {
+            if (count[l]) bits = l;
+        }
+        int next[16];
+        int code = 0;
+        for (int l = 1; l < 16; l++) {
+            code = (code + count[l - 1]) << 1;
+            next[l] = code;
+        }
+        table.assign(1u << bits, 0);
+        for (int sym = 0; sym < n; sym++) {
+            int l = lengths[sym];
+            if (!l) continue;
+            int c = next[l]++;
+            if (c >= (1 << l)) corrupt("over-subscribed Huffman code");
+            uint32_t rev = 0;
+            for (int i = 0; i < l; i++) rev |= ((c >> i) & 1) << (l - 1 - i);
+            for (uint32_t i = rev; i < table.size(); i += 1u << l) {
+                table[i] = (uint16_t)(sym << 4 | l);
+            }
+        }
+    }
+};
+
+class GzipSource : public Source {
+public:
+    explicit GzipSource(std::unique_ptr<FdInput> in)
+        : in_(std::move(in)), out_(32768, 1 << 18) {}
+
+    size_t read(char* dst, size_t cap) override {
+        for (;;) {
+            if (out_.pending()) return out_.drain(dst, cap);
+            if (state_ == DONE) return 0;
+            out_.reserve(1 << 16);
+            step();
+        }
+    }
+
+    bool ready() override { return out_.pending() || (state_ != DONE && in_->ready()); }
+
+private:
+    enum State { MEMBER_HEADER, BLOCK_HEADER, STORED, CODES, MEMBER_TRAILER, DONE };
+
+    std::unique_ptr<FdInput> in_;
+    Window out_;
+    State state_ = MEMBER_HEADER;
+    bool last_block_ = false;
+    size_t stored_left_ = 0;
+    uint32_t member_size_ = 0;
+    Huffman lit_, dist_;
+
+    // LSB-first bit buffer. Past the end of input it is padded with zeros so
+    // the last code can be peeked; consuming padding means truncation.
+    uint64_t bitbuf_ = 0;
+    int bitcnt_ = 0;
+    int padding_ = 0;
+
+    void need(int n) {
+        if (bitcnt_ >= n) return;
+        if (in_->buffered() >= 8) {
+            // Top up with as many whole bytes as fit in one load
+            uint64_t w;
+            memcpy(&w, in_->data(), 8);
+            int take = (63 - bitcnt_) >> 3;
+            bitbuf_ |= w << bitcnt_;
+            bitcnt_ += take * 8;
+            bitbuf_ &= (1ull << bitcnt_) - 1;
+            in_->skip(take);
+            return;
+        }
+        while (bitcnt_ < n) {
+            int c = in_->get();
+            if (c < 0) {
+                c = 0;
+                padding_ += 8;
+            }
+            bitbuf_ |= (uint64_t)c << bitcnt_;
+            bitcnt_ += 8;
+        }
+    }
+
+    void consume(int n) {
+        bitbuf_ >>= n;
+        bitcnt_ -= n;
+        if (bitcnt_ < padding_) corrupt("unexpected end of gzip stream");
+    }
+
+    uint32_t bits(int n) {
+        need(n);
+        uint32_t v = (uint32_t)(bitbuf_ & ((1ull << n) - 1));
+        consume(n);
+        return v;
+    }
+
+    int decode(const Huffman& h) {
+        need(h.bits);
+        uint16_t e = h.table[bitbuf_ & ((1u << h.bits) - 1)];
+        if (!(e & 15)) corrupt("invalid Huffman code");
+        consume(e & 15);
+        return e >> 4;
+    }
+
+    // Next whole byte after the bit buffer is aligned, or -1 at end of input
+    int next_byte() {
+        if (bitcnt_ - padding_ >= 8) return bits(8);
+        bitbuf_ = 0;
+        bitcnt_ = padding_ = 0;
+        return in_->get();
+    }
+
+    void step() {
+        switch (state_) {
+            case MEMBER_HEADER: read_member_header(); break;
+            case BLOCK_HEADER: read_block_header(); break;
+            case STORED: copy_stored(); break;
+            case CODES: decode_codes(); break;
+            case MEMBER_TRAILER: read_member_trailer(); break;
+            case DONE: break;
+        }
+    }
+
+    void read_member_header() {
+        int id1 = next_byte();
+        int id2 = next_byte();
+        if (id1 != 0x1f || id2 != 0x8b) {
+            // End of input; trailing garbage is ignored, as gzip does
+            state_ = DONE;
+            return;
+        }
+        if (bits(8) != 8) corrupt("unknown gzip compression method");
+        uint32_t flags = bits(8);
+        for (int i = 0; i < 6; i++) bits(8); // mtime, xfl, os
+        if (flags & 4) {
+            uint32_t xlen = bits(16);
+            for (uint32_t i = 0; i < xlen; i++) bits(8);
+        }
+        if (flags & 8) while (bits(8) != 0) {}  // file name
+        if (flags & 16) while (bits(8) != 0) {} // comment
+        if (flags & 2) bits(16);                // header crc
+        member_size_ = 0;
+        state_ = BLOCK_HEADER;
+    }
+
+    void read_block_header() {
+        last_block_ = bits(1);
+        switch (bits(2)) {
+            case 0: {
+                consume(bitcnt_ % 8);
+                uint32_t len = bits(16);
+                uint32_t nlen = bits(16);
+                if (len != (~nlen & 0xFFFF)) corrupt("stored block length mismatch");
+                stored_left_ = len;
+                state_ = STORED;
+                break;
+            }
+            case 1: {
+                static Huffman fixed_lit, fixed_dist;
+                if (fixed_lit.table.empty()) {
+                    uint8_t lengths[288];
+                    memset(lengths, 8, 144);
+                    memset(lengths + 144, 9, 112);
+                    memset(lengths + 256, 7, 24);
+                    memset(lengths + 280, 8, 8);
+                    fixed_lit.build(lengths, 288);
+                    memset(lengths, 5, 30);
+                    fixed_dist.build(lengths, 30);
+                }
+                lit_ = fixed_lit;
+                dist_ = fixed_dist;
+                state_ = CODES;
+                break;
+            }
+            case 2:
+                read_dynamic_tables();
+                state_ = CODES;
+                break;
+            default:
+                corrupt("reserved deflate block type");
+        }
+    }
+
+    void read_dynamic_tables() {
+        int hlit = bits(5) + 257;
+        int hdist = bits(5) + 1;
+        int hclen = bits(4) + 4;
+        uint8_t cl[19] = {0};
+        for (int i = 0; i < hclen; i++) cl[CODE_LENGTH_ORDER[i]] = bits(3);
+        Huffman clh;
+        clh.build(cl, 19);
+
+        uint8_t lengths[320] = {0};
+        int i = 0;
+        while (i < hlit + hdist) {
+            int sym = decode(clh);
+            if (sym < 16) {
+                lengths[i++] = sym;
+                continue;
+            }
+            int rep;
+            uint8_t val = 0;
+            if (sym == 16) {
+                if (i == 0) corrupt("repeat with no previous length");
+                val = lengths[i - 1];
+                rep = 3 + bits(2);
+            } else if (sym == 17) {
+                rep = 3 + bits(3);
+            } else {
+                rep = 11 + bits(7);
+            }
+            if (i + rep > hlit + hdist) corrupt("too many code lengths");
+            while (rep--) lengths[i++] = val;
+        }
+        if (lengths[256] == 0) corrupt("no end-of-block code");
+        lit_.build(lengths, hlit);
+        dist_.build(lengths + hlit, hdist);
+    }
+
+    void copy_stored() {
+        size_t n = std::min(stored_left_, out_.space());
+        uint8_t* d = out_.buf.data() + out_.pos;
+        size_t done = 0;
+        // Whole bytes still sitting in the bit buffer come first
+        while (done < n && bitcnt_ - padding_ >= 8) d[done++] = bits(8);
+        if (done < n) {
+            bitbuf_ = 0;
+            bitcnt_ = padding_ = 0;
+            in_->read_exact(d + done, n - done);
+        }
+        out_.pos += n;
+        member_size_ += n;
+        stored_left_ -= n;
+        if (stored_left_ == 0) state_ = last_block_ ? MEMBER_TRAILER : BLOCK_HEADER;
+    }
+
+    void decode_codes() {
+        while (out_.space() >= 258) {
+            int sym = decode(lit_);
+            if (sym < 256) {
+                out_.buf[out_.pos++] = (uint8_t)sym;
+                member_size_++;
+                continue;
+            }
+            if (sym == 256) {
+                state_ = last_block_ ? MEMBER_TRAILER : BLOCK_HEADER;
+                return;
+            }
+            sym -= 257;
+            if (sym >= 29) corrupt("invalid length code");
+            size_t len = LENGTH_BASE[sym] + bits(LENGTH_EXTRA[sym]);
+            int d = decode(dist_);
+            if (d >= 30) corrupt("invalid distance code");
+            size_t dist = DIST_BASE[d] + bits(DIST_EXTRA[d]);
+            out_.copy_match(dist, len);
+            member_size_ += len;
+        }
+    }
+
+    void read_member_trailer() {
+        consume(bitcnt_ % 8);
+        bits(32); // crc32 of the member; the length check below is cheaper
+        if (bits(32) != member_size_) corrupt("gzip length mismatch");
+        state_ = MEMBER_HEADER;
+    }
+};
+
+// --- zstd (RFC 8878) ---
+
+static const int16_t LL_DEFAULT[36] = {4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2,
+                                       2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1, -1, -1, -1, -1};
+static const int16_t ML_DEFAULT[53] = {1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+                                       1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+                                       1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1};
+static const int16_t OF_DEFAULT[29] = {1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1,
+                                       1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1};
+
+static const uint32_t LL_BASE[36] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                     16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512,
+                                     1024, 2048, 4096, 8192, 16384, 32768, 65536};
+static const uint8_t LL_BITS[36] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                    1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const uint32_t ML_BASE[53] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+                                     19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+                                     33, 34, 35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131,
+                                     259, 515, 1027, 2051, 4099, 8195, 16387, 32771, 65539};
+static const uint8_t ML_BITS[53] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1,
+                                    2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+
+static const size_t ZSTD_MAX_WINDOW = (size_t)1 << 27;
+static const size_t ZSTD_MAX_BLOCK = 128 * 1024;
+
+// Forward LSB-first bits, for FSE table headers. Reads past the end yield
+// zeros; callers check bytes() against the real length afterwards.
+struct ForwardBits {
+    const uint8_t* p;
+    size_t n;
+    size_t bit = 0;
+
+    ForwardBits(const uint8_t* p, size_t n) : p(p), n(n) {}
+
+    uint32_t read(int k) {
+        uint32_t v = 0;
+        for (int j = 0; j < k; j++, bit++) {
+            if ((bit >> 3) < n) v |= ((p[bit >> 3] >> (bit & 7)) & 1u) << j;
+        }
+        return v;
+    }
+
+    void rewind(int k) { bit -= k; }
+    size_t bytes() const { return (bit + 7) / 8; }
+};
+
+// Backward bitstream used by Huffman and FSE payloads: starts at the last
+// set bit of the final byte and reads towards the start. Bits before the
+// start read as zeros, which is how the end of a stream is detected.
+struct BackwardBits {
+    const uint8_t* src;
+    size_t len;
+    int64_t offset;
+
+    BackwardBits(const uint8_t* src, size_t len) : src(src), len(len) {
+        if (len == 0 || src[len - 1] == 0) corrupt("bad bitstream padding");
+        offset = (int64_t)len * 8 - (8 - highest_bit(src[len - 1]));
+    }
+
+    uint64_t read(int n) {
+        if (n == 0) return 0;
+        offset -= n;
+        int64_t off = offset;
+        int k = n;
+        if (off < 0) {
+            k += (int)off;
+            off = 0;
+            if (k <= 0) return 0;
+        }
+        size_t byte = (size_t)off >> 3;
+        uint64_t v = 0;
+        size_t avail = std::min<size_t>(8, len - byte);
+        memcpy(&v, src + byte, avail);
+        v = (v >> (off & 7)) & ((1ull << k) - 1);
+        if (offset < 0) v <<= -offset;
+        return v;
+    }
+};
+
+struct FseTable {
+    int accuracy_log = 0;
+    bool valid = false;
+    std::vector<uint8_t> symbols;
+    std::vector<uint8_t> num_bits;
+    std::vector<uint16_t> base;
+
+    void build(const int16_t* norm, int nsym, int al) {
+        size_t size = (size_t)1 << al;
+        accuracy_log = al;
+        symbols.assign(size, 0);
+        num_bits.assign(size, 0);
+        base.assign(size, 0);
+
+        // Low-probability symbols take the top slots, the rest are spread
+        std::vector<uint16_t> next(nsym);
+        int high = (int)size - 1;
+        for (int s = 0; s < nsym; s++) {
+            if (norm[s] == -1) {
+                symbols[high--] = (uint8_t)s;
+                next[s] = 1;
+            }
+        }
+        int step = (int)(size >> 1) + (int)(size >> 3) + 3;
+        int mask = (int)size - 1;
+        int pos = 0;
+        for (int s = 0; s < nsym; s++) {
+            if (norm[s] <= 0) continue;
+            next[s] = norm[s];
+            for (int i = 0; i < norm[s]; i++) {
+                symbols[pos] = (uint8_t)s;
+                do {
+                    pos = (pos + step) & mask;
+                } while (pos > high);
+            }
+        }
+        if (pos != 0) corrupt("bad FSE distribution");
+
+        for (size_t i = 0; i < size; i++) {
+            uint16_t x = next[symbols[i]]++;
+            num_bits[i] = (uint8_t)(al - highest_bit(x));
+            base[i] = (uint16_t)((x << num_bits[i]) - size);
+        }
+        valid = true;
+    }
+
+    void build_rle(uint8_t sym) {
+        accuracy_log = 0;
+        symbols.assign(1, sym);
+        num_bits.assign(1, 0);
+        base.assign(1, 0);
+        valid = true;
+    }
+
+    // Reads a normalized distribution header and builds the table from it
+    void read(ForwardBits& in, int max_al, int max_sym) {
+        int16_t norm[256];
+        int al = in.read(4) + 5;
+        if (al > max_al) corrupt("FSE accuracy too high");
+        int remaining = 1 << al;
+        int symb = 0;
+        while (remaining > 0 && symb <= max_sym) {
+            int bits = highest_bit(remaining + 1) + 1;
+            uint32_t val = in.read(bits);
+            uint32_t lower_mask = (1u << (bits - 1)) - 1;
+            uint32_t threshold = (1u << bits) - 1 - (remaining + 1);
+            if ((val & lower_mask) < threshold) {
+                in.rewind(1);
+                val &= lower_mask;
+            } else if (val > lower_mask) {
+                val -= threshold;
+            }
+            int proba = (int)val - 1;
+            remaining -= proba < 0 ? -proba : proba;
+            norm[symb++] = (int16_t)proba;
+            if (proba == 0) {
+                int repeat = in.read(2);
+                for (;;) {
+                    for (int i = 0; i < repeat && symb <= max_sym; i++) norm[symb++] = 0;
+                    if (repeat != 3) break;
+                    repeat = in.read(2);
+                }
+            }
+        }
+        if (remaining != 0 || in.bytes() > in.n) corrupt("bad FSE header");
+        build(norm, symb, al);
+    }
+};
+
+struct HufTable {
+    int max_bits = 0;
+    bool valid = false;
+    std::vector<uint8_t> symbols;
+    std::vector<uint8_t> num_bits;
+
+    // `weights` holds all but the last symbol's weight, which is implied
+    void build(uint8_t* weights, int n) {
+        uint32_t sum = 0;
+        for (int i = 0; i < n; i++) {
+            if (weights[i] > 12) corrupt("Huffman weight too large");
+            if (weights[i]) sum += 1u << (weights[i] - 1);
+        }
+        if (sum == 0) corrupt("empty Huffman table");
+        max_bits = highest_bit(sum) + 1;
+        uint32_t left = (1u << max_bits) - sum;
+        if (left & (left - 1)) corrupt("incomplete Huffman table");
+        weights[n++] = (uint8_t)(highest_bit(left) + 1);
+        if (max_bits > 11) corrupt("Huffman code too long");
+
+        uint8_t bits[256];
+        uint32_t rank_count[13] = {0};
+        for (int i = 0; i < n; i++) {
+            bits[i] = weights[i] ? (uint8_t)(max_bits + 1 - weights[i]) : 0;
+            rank_count[bits[i]]++;
+        }
+        // Longest codes first; within a length, in symbol order
+        uint32_t rank_idx[13];
+        rank_idx[max_bits] = 0;
+        size_t size = (size_t)1 << max_bits;
+        symbols.assign(size, 0);
+        num_bits.assign(size, 0);
+        for (int b = max_bits; b >= 1; b--) {
+            rank_idx[b - 1] = rank_idx[b] + rank_count[b] * (1u << (max_bits - b));
+            memset(&num_bits[rank_idx[b]], b, rank_idx[b - 1] - rank_idx[b]);
+        }
+        for (int i = 0; i < n; i++) {
+            if (!bits[i]) continue;
+            uint32_t len = 1u << (max_bits - bits[i]);
+            memset(&symbols[rank_idx[bits[i]]], i, len);
+            rank_idx[bits[i]] += len;
+        }
+        valid = true;
+    }
+
+    void decode(const uint8_t* src, size_t len, uint8_t* out, size_t n) const {
+        BackwardBits in(src, len);
+        uint32_t mask = (1u << max_bits) - 1;
+        uint32_t state = (uint32_t)in.read(max_bits);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = symbols[state];
+            int nb = num_bits[state];
+            state = ((state << nb) | (uint32_t)in.read(nb)) & mask;
+        }
+        if (in.offset != -max_bits) corrupt("Huffman stream length mismatch");
+    }
+};
+
+class ZstdSource : public Source {
+public:
+    explicit ZstdSource(std::unique_ptr<FdInput> in) : in_(std::move(in)) {}
+
+    size_t read(char* dst, size_t cap) override {
+        for (;;) {
+            if (out_ && out_->pending()) return out_->drain(dst, cap);
+            switch (state_) {
+                case DONE: return 0;
+                case FRAME_HEADER: read_frame_header(); break;
+                case BLOCK: decode_block(); break;
+            }
+        }
+    }
+
+    bool ready() override {
+        return (out_ && out_->pending()) || (state_ != DONE && in_->ready());
+    }
+
+private:
+    enum State { FRAME_HEADER, BLOCK, DONE };
+
+    std::unique_ptr<FdInput> in_;
+    std::unique_ptr<Window> out_;
+    State state_ = FRAME_HEADER;
+    bool checksum_ = false;
+    size_t block_max_ = 0;
+    std::vector<uint8_t> block_;
+    std::vector<uint8_t> literals_;
+
+    // Entropy tables and repeat offsets carry over between blocks of a frame
+    HufTable huf_;
+    FseTable ll_, of_, ml_;
+    uint32_t rep_[3];
+
+    uint8_t byte() {
+        uint8_t b;
+        in_->read_exact(&b, 1);
+        return b;
+    }
+
+    uint64_t le(int n) {
+        uint64_t v = 0;
+        for (int i = 0; i < n; i++) v |= (uint64_t)byte() << (8 * i);
+        return v;
+    }
+
+    void read_frame_header() {
+        size_t got = in_->peek(4);
+        if (got == 0) {
+            state_ = DONE;
+            return;
+        }
+        if (got < 4) corrupt("truncated zstd frame");
+        uint32_t magic = le32(in_->data());
+        in_->skip(4);
+        if ((magic & 0xFFFFFFF0) == 0x184D2A50) {
+            // Skippable frame
+            uint64_t size = le(4);
+            while (size--) byte();
+            return;
+        }
+        if (magic != 0xFD2FB528) corrupt("unknown zstd frame");
+
+        uint8_t fhd = byte();
+        int fcs_flag = fhd >> 6;
+        bool single_segment = (fhd >> 5) & 1;
+        if (fhd & 8) corrupt("reserved zstd header bit set");
+        checksum_ = (fhd >> 2) & 1;
+        int dict_flag = fhd & 3;
+
+        uint64_t window = 0;
+        if (!single_segment) {
+            uint8_t wd = byte();
+            uint64_t base = 1ull << (10 + (wd >> 3));
+            window = base + (base / 8) * (wd & 7);
+        }
+        static const int DICT_BYTES[4] = {0, 1, 2, 4};
+        if (le(DICT_BYTES[dict_flag]) != 0) {
+            throw std::runtime_error("zstd dictionaries are not supported");
+        }
+        static const int FCS_BYTES[4] = {0, 2, 4, 8};
+        int fcs_bytes = (fcs_flag == 0 && single_segment) ? 1 : FCS_BYTES[fcs_flag];
+        uint64_t content_size = le(fcs_bytes);
+        if (fcs_bytes == 2) content_size += 256;
+        if (single_segment) window = content_size;
+        if (window > ZSTD_MAX_WINDOW) throw std::runtime_error("zstd window too large");
+
+        block_max_ = std::min<size_t>(window, ZSTD_MAX_BLOCK);
+        if (!out_ || out_->history != window) {
+            out_ = std::make_unique<Window>(window, std::max<size_t>(window, 1 << 20) + ZSTD_MAX_BLOCK);
+        }
+        out_->pos = out_->delivered = 0;
+        huf_.valid = ll_.valid = of_.valid = ml_.valid = false;
+        rep_[0] = 1;
+        rep_[1] = 4;
+        rep_[2] = 8;
+        state_ = BLOCK;
+    }
+
+    void decode_block() {
+        uint32_t header = (uint32_t)le(3);
+        bool last = header & 1;
+        int type = (header >> 1) & 3;
+        size_t size = header >> 3;
+        if (size > block_max_) corrupt("zstd block too large");
+
+        out_->reserve(ZSTD_MAX_BLOCK);
+        switch (type) {
+            case 0:
+                in_->read_exact(out_->buf.data() + out_->pos, size);
+                out_->pos += size;
+                break;
+            case 1:
+                memset(out_->buf.data() + out_->pos, byte(), size);
+                out_->pos += size;
+                break;
+            case 2:
+                block_.resize(size);
+                in_->read_exact(block_.data(), size);
+                decompress_block(block_.data(), size);
+                break;
+            default:
+                corrupt("reserved zstd block type");
+        }
+
+        if (last) {
+            if (checksum_) le(4); // xxh64 content checksum, not verified
+            state_ = FRAME_HEADER;
+        }
+    }
+
+    void decompress_block(const uint8_t* src, size_t n) {
+        size_t used = decode_literals(src, n);
+        decode_sequences(src + used, n - used);
+    }
+
+    size_t decode_literals(const uint8_t* src, size_t n) {
+        if (n < 1) corrupt("empty zstd block");
+        int type = src[0] & 3;
+        int size_format = (src[0] >> 2) & 3;
+        size_t regen, header;
+
+        if (type < 2) {
+            if (size_format == 1) {
+                header = 2;
+            } else if (size_format == 3) {
+                header = 3;
+            } else {
+                header = 1;
+            }
+            if (n < header) corrupt("truncated literals header");
+            if (header == 1) {
+                regen = src[0] >> 3;
+            } else if (header == 2) {
+                regen = (src[0] >> 4) + (src[1] << 4);
+            } else {
+                regen = (src[0] >> 4) + (src[1] << 4) + (src[2] << 12);
+            }
+            if (regen > ZSTD_MAX_BLOCK) corrupt("too many literals");
+            if (type == 0) {
+                if (n < header + regen) corrupt("truncated literals");
+                literals_.assign(src + header, src + header + regen);
+                return header + regen;
+            }
+            if (n < header + 1) corrupt("truncated literals");
+            literals_.assign(regen, src[header]);
+            return header + 1;
+        }
+
+        size_t compressed;
+        int streams = size_format == 0 ? 1 : 4;
+        header = size_format <= 1 ? 3 : size_format + 2;
+        if (n < header) corrupt("truncated literals header");
+        uint64_t h = 0;
+        for (size_t i = 0; i < header; i++) h |= (uint64_t)src[i] << (8 * i);
+        if (header == 3) {
+            regen = (h >> 4) & 0x3FF;
+            compressed = (h >> 14) & 0x3FF;
+        } else if (header == 4) {
+            regen = (h >> 4) & 0x3FFF;
+            compressed = (h >> 18) & 0x3FFF;
+        } else {
+            regen = (h >> 4) & 0x3FFFF;
+            compressed = (h >> 22) & 0x3FFFF;
+        }
+        if (regen > ZSTD_MAX_BLOCK) corrupt("too many literals");
+        if (n < header + compressed) corrupt("truncated literals");
+
+        const uint8_t* p = src + header;
+        size_t len = compressed;
+        if (type == 2) {
+            size_t t = read_huffman_table(p, len);
+            p += t;
+            len -= t;
+        } else if (!huf_.valid) {
+            corrupt("treeless literals without a previous table");
+        }
+
+        literals_.resize(regen);
+        if (streams == 1) {
+            huf_.decode(p, len, literals_.data(), regen);
+        } else {
+            if (len < 6) corrupt("truncated jump table");
+            size_t sizes[4] = {le16(p), le16(p + 2), le16(p + 4), 0};
+            if (sizes[0] + sizes[1] + sizes[2] + 6 > len) corrupt("bad jump table");
+            sizes[3] = len - 6 - sizes[0] - sizes[1] - sizes[2];
+            size_t segment = (regen + 3) / 4;
+            if (3 * segment > regen) corrupt("too few literals for four streams");
+            const uint8_t* s = p + 6;
+            for (int i = 0; i < 4; i++) {
+                size_t count = i < 3 ? segment : regen - 3 * segment;
+                huf_.decode(s, sizes[i], literals_.data() + i * segment, count);
+                s += sizes[i];
+            }
+        }
+        return header + compressed;
+    }
+
+    size_t read_huffman_table(const uint8_t* p, size_t len) {
+        if (len < 1) corrupt("missing Huffman table");
+        uint8_t weights[256];
+        int n = 0;
+        int header = p[0];
+        size_t used;
+        if (header < 128) {
+            // FSE-compressed weights, decoded with two interleaved states
+            used = 1 + header;
+            if (used > len) corrupt("truncated Huffman table");
+            ForwardBits fb(p + 1, header);
+            FseTable t;
+            t.read(fb, 6, 255);
+            size_t table_bytes = fb.bytes();
+            BackwardBits in(p + 1 + table_bytes, header - table_bytes);
+            uint32_t s1 = (uint32_t)in.read(t.accuracy_log);
+            uint32_t s2 = (uint32_t)in.read(t.accuracy_log);
+            for (;;) {
+                if (n >= 254) corrupt("too many Huffman weights");
+                weights[n++] = t.symbols[s1];
+                s1 = t.base[s1] + (uint32_t)in.read(t.num_bits[s1]);
+                if (in.offset < 0) {
+                    weights[n++] = t.symbols[s2];
+                    break;
+                }
+                weights[n++] = t.symbols[s2];
+                s2 = t.base[s2] + (uint32_t)in.read(t.num_bits[s2]);
+                if (in.offset < 0) {
+                    weights[n++] = t.symbols[s1];
+                    break;
+                }
+            }
+        } else {
+            // Direct 4-bit weights
+            n = header - 127;
+            used = 1 + (n + 1) / 2;
+            if (used > len) corrupt("truncated Huffman table");
+            for (int i = 0; i < n; i++) {
+                weights[i] = (i & 1) ? (p[1 + i / 2] & 15) : (p[1 + i / 2] >> 4);
+            }
+        }
+        huf_.build(weights, n);
+        return used;
+    }
+
+    size_t setup_table(FseTable& t, int mode, const uint8_t* p, size_t n, const int16_t* def,
+                       int def_n, int def_al, int max_al, int max_sym) {
+        switch (mode) {
+            case 0:
+                t.build(def, def_n, def_al);
+                return 0;
+            case 1:
+                if (n < 1 || p[0] > max_sym) corrupt("bad RLE sequence table");
+                t.build_rle(p[0]);
+                return 1;
+            case 2: {
+                ForwardBits fb(p, n);
+                t.read(fb, max_al, max_sym);
+                return fb.bytes();
+            }
+            default:
+                if (!t.valid) corrupt("repeat sequence table without a previous one");
+                return 0;
+        }
+    }
+
+    uint32_t resolve_offset(uint32_t value, uint32_t literal_length) {
+        if (value > 3) {
+            uint32_t offset = value - 3;
+            rep_[2] = rep_[1];
+            rep_[1] = rep_[0];
+            rep_[0] = offset;
+            return offset;
+        }
+        // Repeat offsets; shifted by one when there are no literals
+        uint32_t idx = value - 1 + (literal_length == 0);
+        if (idx == 0) return rep_[0];
+        uint32_t offset = idx < 3 ? rep_[idx] : rep_[0] - 1;
+        if (idx > 1) rep_[2] = rep_[1];
+        rep_[1] = rep_[0];
+        rep_[0] = offset;
+        return offset;
+    }
+
+    void decode_sequences(const uint8_t* p, size_t n) {
+        if (n < 1) corrupt("missing sequences section");
+        size_t count;
+        size_t i;
+        if (p[0] < 128) {
+            count = p[0];
+            i = 1;
+        } else if (p[0] < 255) {
+            if (n < 2) corrupt("truncated sequences header");
+            count = ((p[0] - 128) << 8) + p[1];
+            i = 2;
+        } else {
+            if (n < 3) corrupt("truncated sequences header");
+            count = p[1] + (p[2] << 8) + 0x7F00;
+            i = 3;
+        }
+
+        size_t lit = 0;
+        if (count > 0) {
+            if (n < i + 1) corrupt("truncated sequences header");
+            int modes = p[i++];
+            i += setup_table(ll_, modes >> 6, p + i, n - i, LL_DEFAULT, 36, 6, 9, 35);
+            i += setup_table(of_, (modes >> 4) & 3, p + i, n - i, OF_DEFAULT, 29, 5, 8, 31);
+            i += setup_table(ml_, (modes >> 2) & 3, p + i, n - i, ML_DEFAULT, 53, 6, 9, 52);
+            if (i > n) corrupt("truncated sequence tables");
+
+            BackwardBits in(p + i, n - i);
+            uint32_t ll_state = (uint32_t)in.read(ll_.accuracy_log);
+            uint32_t of_state = (uint32_t)in.read(of_.accuracy_log);
+            uint32_t ml_state = (uint32_t)in.read(ml_.accuracy_log);
+
+            for (size_t s = 0; s < count; s++) {
+                int of_code = of_.symbols[of_state];
+                int ll_code = ll_.symbols[ll_state];
+                int ml_code = ml_.symbols[ml_state];
+                if (of_code > 31 || ll_code > 35 || ml_code > 52) corrupt("bad sequence code");
+
+                uint32_t offset_value = (1u << of_code) + (uint32_t)in.read(of_code);
+                uint32_t match_length = ML_BASE[ml_code] + (uint32_t)in.read(ML_BITS[ml_code]);
+                uint32_t literal_length = LL_BASE[ll_code] + (uint32_t)in.read(LL_BITS[ll_code]);
+
+                if (s + 1 < count) {
+                    ll_state = ll_.base[ll_state] + (uint32_t)in.read(ll_.num_bits[ll_state]);
+                    ml_state = ml_.base[ml_state] + (uint32_t)in.read(ml_.num_bits[ml_state]);
+                    of_state = of_.base[of_state] + (uint32_t)in.read(of_.num_bits[of_state]);
+                }
+
+                uint32_t offset = resolve_offset(offset_value, literal_length);
+                if (lit + literal_length > literals_.size()) corrupt("sequence overruns literals");
+                out_->append(literals_.data() + lit, literal_length);
+                lit += literal_length;
+                out_->copy_match(offset, match_length);
+            }
+            if (in.offset != 0) corrupt("sequence stream length mismatch");
+        }
+        out_->append(literals_.data() + lit, literals_.size() - lit);
+    }
+};
+
+std::unique_ptr<Source> open_source(int fd) {
+    auto in = std::make_unique<FdInput>(fd);
+
+    // Only wait for more than one byte when it could start a magic number,
+    // so interactive input isn't held back
+    size_t got = in->peek(1);
+    if (got >= 1 && in->data()[0] == 0x1f && in->peek(2) >= 2 && in->data()[1] == 0x8b) {
+        return std::make_unique<GzipSource>(std::move(in));
+    }
+    if (got >= 1 && in->data()[0] == 0x28 && in->peek(4) >= 4 && le32(in->data()) == 0xFD2FB528) {
+        return std::make_unique<ZstdSource>(std::move(in));
+    }
+    return std::make_unique<PlainSource>(std::move(in));
+}
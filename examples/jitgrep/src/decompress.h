@@ -0,0 +1,9 @@
+#pragma once
+#include <memory>
+#include "reader.h"
+
+// Wraps `fd` in a Source that decompresses gzip and zstd streams, detected
+// by their magic numbers. Anything else is passed through unchanged.
+// Concatenated gzip members and zstd frames are decoded back to back, into
+// a window of their own and copied from there into the caller's buffer.
+std::unique_ptr<Source> open_source(int fd);
@@ -0,0 +1,152 @@
+#include "dfa.h"
+#include <algorithm>
+
+LazyDfa::LazyDfa(const Glushkov& g, size_t cache_limit)
+    : g_(g), cache_limit_(cache_limit), mark_(g.symbol.size(), 0) {
+    // A class boundary wherever some position's byte starts or ends
+    bool boundary[257] = {};
+    boundary[0] = true;
+    boundary['\n'] = boundary['\n' + 1] = true;
+    for (uint16_t sym : g.symbol) {
+        if (sym < 256) boundary[sym] = boundary[sym + 1] = true;
+    }
+    int cls = -1;
+    for (int c = 0; c < 256; c++) {
+        if (boundary[c]) {
+            cls++;
+            representative_.push_back(c);
+        }
+        classes_[c] = (uint8_t)cls;
+    }
+    class_count_ = cls + 1;
+    nl_class_ = classes_['\n'];
+    reset();
+}
+
+size_t LazyDfa::SetHash::operator()(const std::vector<uint32_t>& set) const {
+    uint64_t h = 1469598103934665603ull; // FNV-1a
+    for (uint32_t p : set) {
+        h ^= p;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+void LazyDfa::reset() {
+    index_.clear();
+    states_.clear();
+    table_.clear();
+    set_bytes_ = 0;
+    intern(step({}, SYM_BOL)); // state 0 is the start
+}
+
+// Positions entered on `sym` from the positions in `from` or from the start
+std::vector<uint32_t> LazyDfa::step(const std::vector<uint32_t>& from, uint16_t sym) {
+    if (++generation_ == 0) {
+        std::fill(mark_.begin(), mark_.end(), 0);
+        generation_ = 1;
+    }
+    std::vector<uint32_t> to;
+    auto visit = [&](const std::vector<uint32_t>& set) {
+        for (uint32_t q : set) {
+            if (mark_[q] != generation_ && g_.matches(q, sym)) {
+                mark_[q] = generation_;
+                to.push_back(q);
+            }
+        }
+    };
+    visit(g_.first);
+    for (uint32_t p : from) visit(g_.follow[p]);
+
+    // Anchors take no input: ^^ and $$ match one BOL or EOL, so follow
+    // anchor positions to further ones of the same kind
+    if (sym >= 256) {
+        for (size_t i = 0; i < to.size(); i++) visit(g_.follow[to[i]]);
+    }
+    std::sort(to.begin(), to.end());
+    return to;
+}
+
+// Patterns with a match ending in one of the positions in `set`
+std::vector<uint32_t> LazyDfa::accepted(const std::vector<uint32_t>& set) const {
+    std::vector<uint32_t> patterns;
+    for (uint32_t p : set) {
+        if (g_.last[p]) patterns.push_back(g_.pattern[p]);
+    }
+    std::sort(patterns.begin(), patterns.end());
+    patterns.erase(std::unique(patterns.begin(), patterns.end()), patterns.end());
+    return patterns;
+}
+
+uint32_t LazyDfa::intern(std::vector<uint32_t> set) {
+    auto found = index_.find(set);
+    if (found != index_.end()) return found->second;
+
+    uint32_t id = (uint32_t)states_.size();
+    set_bytes_ += set.size() * sizeof(uint32_t) + sizeof(State);
+    auto inserted = index_.emplace(std::move(set), id).first;
+    State state;
+    state.positions = &inserted->first;
+    state.accepts = accepted(inserted->first);
+    states_.push_back(std::move(state));
+    table_.resize(table_.size() + class_count_, UNKNOWN);
+    return id;
+}
+
+const std::vector<uint32_t>& LazyDfa::eol_accepts(uint32_t state) {
+    State& s = states_[state];
+    if (!s.eol_known) {
+        s.eol_accepts = accepted(step(*s.positions, SYM_EOL));
+        s.eol_known = true;
+    }
+    return s.eol_accepts;
+}
+
+uint32_t LazyDfa::compute(uint32_t state, uint8_t cls) {
+    uint32_t t;
+    if (cls == nl_class_) {
+        t = start() | (eol_accepts(state).empty() ? 0 : MATCH);
+    } else {
+        std::vector<uint32_t> set = step(*states_[state].positions, representative_[cls]);
+        if (memory() > cache_limit_ && !index_.count(set)) {
+            // Start over; `state` no longer exists, so the transition
+            // cannot be recorded
+            reset();
+            flushes_++;
+            uint32_t id = intern(std::move(set));
+            return id | (states_[id].accepts.empty() ? 0 : MATCH);
+        }
+        uint32_t id = intern(std::move(set));
+        t = id | (states_[id].accepts.empty() ? 0 : MATCH);
+    }
+    table_[(size_t)state * class_count_ + cls] = t;
+    return t;
+}
+
+bool complete_dfa(LazyDfa& dfa, size_t max_states, CompleteDfa& out) {
+    std::vector<uint32_t> order = {dfa.start()};
+    std::vector<int32_t> index(dfa.state_count(), -1); // DFA state -> number, or -1
+    index[dfa.start()] = 0;
+    out.next.clear();
+    out.eol_accepts.clear();
+    for (size_t i = 0; i < order.size(); i++) {
+        std::vector<uint32_t> row(dfa.class_count());
+        for (size_t cls = 0; cls < row.size(); cls++) {
+            uint32_t t = dfa.next(order[i], (uint8_t)cls);
+            if (t & LazyDfa::MATCH) {
+                row[cls] = CompleteDfa::MATCH;
+                continue;
+            }
+            if (t >= index.size()) index.resize(t + 1, -1);
+            if (index[t] < 0) {
+                if (order.size() == max_states) return false;
+                index[t] = (int32_t)order.size();
+                order.push_back(t);
+            }
+            row[cls] = index[t];
+        }
+        out.next.push_back(std::move(row));
+        out.eol_accepts.push_back(!dfa.eol_accepts(order[i]).empty());
+    }
+    return true;
+}
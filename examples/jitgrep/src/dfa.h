@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "glushkov.h"
+
+// A DFA over a Glushkov automaton, built lazily while scanning: each state
+// is a set of positions, and its transitions are filled in the first time
+// they are taken. The start is re-entered at every step, so the DFA finds
+// matches beginning anywhere in a line.
+//
+// Bytes that no pattern tells apart share a class. '\n' is a class of its
+// own whose transition performs EOL and then BOL, so the DFA runs straight
+// across line boundaries. Once the tables outgrow the cache limit they are
+// thrown away and rebuilt from the current state onwards.
+class LazyDfa {
+public:
+    static constexpr uint32_t MATCH = 1u << 31; // tags transitions into accepting states
+    static constexpr uint32_t UNKNOWN = ~0u;
+
+    explicit LazyDfa(const Glushkov& g, size_t cache_limit = 32 << 20);
+
+    LazyDfa(const LazyDfa&) = delete;
+    LazyDfa& operator=(const LazyDfa&) = delete;
+
+    // The state at the start of a line, after BOL
+    uint32_t start() const { return 0; }
+
+    uint8_t byte_class(uint8_t c) const { return classes_[c]; }
+    size_t class_count() const { return class_count_; }
+
+    // The transition on a byte class, tagged MATCH if it accepts. For '\n'
+    // that means the line which just ended matched at EOL. May flush the
+    // cache: only the returned state stays valid.
+    uint32_t next(uint32_t state, uint8_t cls) {
+        uint32_t t = table_[(size_t)state * class_count_ + cls];
+        return t != UNKNOWN ? t : compute(state, cls);
+    }
+
+    // Patterns (0-based) with a match ending on entry to `state`
+    const std::vector<uint32_t>& accepts(uint32_t state) const { return states_[state].accepts; }
+
+    // Patterns with a match ending at EOL right after `state`
+    const std::vector<uint32_t>& eol_accepts(uint32_t state);
+
+    size_t state_count() const { return states_.size(); }
+    size_t memory() const { return table_.size() * sizeof(uint32_t) + set_bytes_; }
+    uint64_t flushes() const { return flushes_; }
+
+private:
+    struct SetHash {
+        size_t operator()(const std::vector<uint32_t>& set) const;
+    };
+
+    struct State {
+        const std::vector<uint32_t>* positions; // key in index_
+        std::vector<uint32_t> accepts;
+        std::vector<uint32_t> eol_accepts;
+        bool eol_known = false;
+    };
+
+    uint32_t compute(uint32_t state, uint8_t cls);
+    std::vector<uint32_t> step(const std::vector<uint32_t>& from, uint16_t sym);
+    std::vector<uint32_t> accepted(const std::vector<uint32_t>& set) const;
+    uint32_t intern(std::vector<uint32_t> set);
+    void reset();
+
+    const Glushkov& g_;
+    size_t cache_limit_;
+    uint8_t classes_[256];
+    std::vector<uint16_t> representative_; // a byte of each class
+    uint32_t class_count_ = 0;
+    uint8_t nl_class_ = 0;
+
+    std::unordered_map<std::vector<uint32_t>, uint32_t, SetHash> index_;
+    std::vector<State> states_;
+    std::vector<uint32_t> table_; // class_count_ entries per state
+    size_t set_bytes_ = 0;
+    uint64_t flushes_ = 0;
+
+    std::vector<uint32_t> mark_; // per position: generation it was added in
+    uint32_t generation_ = 0;
+};
+
+// The part of a DFA reachable from its start without passing a match,
+// built whole for engines that compile it ahead of the scan. States are
+// numbered in the order found, the start first.
+struct CompleteDfa {
+    static constexpr uint32_t MATCH = ~0u;
+
+    std::vector<std::vector<uint32_t>> next; // per state and byte class: the next state, or MATCH
+    std::vector<bool> eol_accepts;           // per state: a match ends at EOL after it
+};
+
+// Build the reachable part of `dfa`, or return false if it has more than
+// `max_states` states. `dfa` must not flush its cache meanwhile.
+bool complete_dfa(LazyDfa& dfa, size_t max_states, CompleteDfa& out);
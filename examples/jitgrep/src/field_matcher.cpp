@@ -0,0 +1,47 @@
+#include "matcher.h"
+#include "newlines.h"
+#include <cstring>
+
+FieldMatcher::FieldMatcher(std::unique_ptr<Matcher> matcher, char delim, size_t index)
+    : matcher_(std::move(matcher)), delim_(delim), index_(index) {
+    // Engines see no lines in an empty buffer, so empty fields are decided
+    // once, as an empty line
+    static const char empty_line[] = "\n";
+    empty_matches_ = matcher_->find(empty_line, empty_line + 1) != empty_line + 1;
+}
+
+bool FieldMatcher::field(const char* bol, const char* stop, const char*& begin, const char*& end) const {
+    begin = bol;
+    end = find_delimiter(bol, stop, delim_);
+    for (size_t k = 0; k < index_; k++) {
+        if (end == stop || *end != delim_) return false;
+        begin = end + 1;
+        end = find_delimiter(begin, stop, delim_);
+    }
+    return true;
+}
+
+const char* FieldMatcher::find(const char* begin, const char* end) {
+    const char* p = begin;
+    while (p < end) {
+        const char* fb;
+        const char* fe;
+        if (field(p, end, fb, fe) && (fb == fe ? empty_matches_ : matcher_->find(fb, fe) != fe)) return p;
+
+        // On to the next line, from wherever the field scan stopped
+        const char* eol = fe < end && *fe == '\n' ? fe : static_cast<const char*>(memchr(fe, '\n', end - fe));
+        if (!eol) break;
+        p = eol + 1;
+    }
+    return end;
+}
+
+void FieldMatcher::pattern_ids(const char* bol, const char* eol, std::vector<uint32_t>& ids) {
+    const char* fb;
+    const char* fe;
+    if (field(bol, eol, fb, fe)) {
+        matcher_->pattern_ids(fb, fe, ids);
+    } else {
+        ids.clear();
+    }
+}
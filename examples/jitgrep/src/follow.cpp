@@ -0,0 +1,183 @@
+#include "follow.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Every file is rechecked this often even without events, which covers
+// file systems where inotify misses changes (NFS and the like)
+static const int RECHECK_MS = 1000;
+
+static const size_t READ_SIZE = 1 << 20;
+
+static const uint32_t WATCH_EVENTS =
+    IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE;
+
+Follower::Follower(Matcher& matcher, const GrepOptions& options, Stats& stats, std::ostream& out)
+    : matcher_(matcher), options_(options), stats_(stats), out_(out), buf_(READ_SIZE) {
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_ < 0) throw std::runtime_error(std::string("inotify: ") + strerror(errno));
+}
+
+Follower::~Follower() {
+    for (auto& f : files_) close_file(*f);
+    close(inotify_);
+}
+
+void Follower::add(const char* path, const char* label) {
+    auto f = std::make_unique<File>();
+    f->path = path;
+    f->label = label;
+    f->grep = std::make_unique<Grep>(matcher_, options_, stats_, out_);
+
+    // Watching the directory sees the file being replaced or created too
+    size_t slash = f->path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : f->path.substr(0, slash);
+    f->name = slash == std::string::npos ? f->path : f->path.substr(slash + 1);
+    f->watch = inotify_add_watch(inotify_, dir.c_str(), WATCH_EVENTS);
+    if (f->watch < 0) throw std::runtime_error(dir + ": " + strerror(errno));
+
+    // Only what is appended from now on is of interest
+    if (open_file(*f)) {
+        struct stat st;
+        if (fstat(f->fd, &st) == 0) f->offset = st.st_size;
+    }
+    files_.push_back(std::move(f));
+}
+
+void Follower::run() {
+    alignas(inotify_event) char events[64 * 1024];
+    for (;;) {
+        pollfd p = {inotify_, POLLIN, 0};
+        int ready = poll(&p, 1, RECHECK_MS);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("poll: ") + strerror(errno));
+        }
+        if (ready == 0) {
+            for (auto& f : files_) check(*f);
+            continue;
+        }
+
+        ssize_t len = read(inotify_, events, sizeof events);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            throw std::runtime_error(std::string("inotify: ") + strerror(errno));
+        }
+
+        // Check each affected file once per batch of events
+        std::vector<bool> touched(files_.size());
+        for (char* at = events; at < events + len;) {
+            auto* e = reinterpret_cast<inotify_event*>(at);
+            at += sizeof(inotify_event) + e->len;
+            for (size_t i = 0; i < files_.size(); i++) {
+                const File& f = *files_[i];
+                if ((e->mask & IN_Q_OVERFLOW) || (e->wd == f.watch && e->len && f.name == e->name)) {
+                    touched[i] = true;
+                }
+            }
+        }
+        for (size_t i = 0; i < files_.size(); i++) {
+            if (touched[i]) check(*files_[i]);
+        }
+    }
+}
+
+// Open `f.path` to be read from its start. False if it does not exist.
+bool Follower::open_file(File& f) {
+    f.fd = open(f.path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (f.fd < 0 || fstat(f.fd, &st) != 0) {
+        if (errno != ENOENT) std::cerr << "Error: " << f.path << ": " << strerror(errno) << std::endl;
+        close_file(f);
+        return false;
+    }
+    f.dev = st.st_dev;
+    f.ino = st.st_ino;
+    f.offset = 0;
+    f.carry.clear();
+    f.grep->start(f.label);
+    return true;
+}
+
+void Follower::close_file(File& f) {
+    if (f.fd < 0) return;
+    close(f.fd);
+    f.fd = -1;
+    f.grep->finish();
+}
+
+// Pick up what changed about `f`: appended lines, truncation, or a new
+// file under its name
+void Follower::check(File& f) {
+    struct stat st;
+    bool exists = stat(f.path.c_str(), &st) == 0;
+    // A file renamed away is still read until another appears under its
+    // name, as writers usually reopen the name only after rotation
+    if (f.fd >= 0 && exists && (st.st_dev != f.dev || st.st_ino != f.ino)) {
+        // Writes that made it into the old file before the switch still
+        // count, including a last unterminated line
+        read_appended(f);
+        if (!f.carry.empty()) {
+            std::string last;
+            last.swap(f.carry);
+            feed(f, last.data(), last.size());
+        }
+        close_file(f);
+    }
+    if (f.fd < 0 && (!exists || !open_file(f))) return;
+    read_appended(f);
+}
+
+void Follower::read_appended(File& f) {
+    struct stat st;
+    if (fstat(f.fd, &st) == 0 && st.st_size < f.offset) {
+        // Truncated in place (copytruncate rotation): start over
+        f.offset = 0;
+        f.carry.clear();
+        f.grep->finish();
+        f.grep->start(f.label);
+    }
+    for (;;) {
+        ssize_t n = pread(f.fd, buf_.data(), buf_.size(), f.offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: " << f.path << ": " << strerror(errno) << std::endl;
+            return;
+        }
+        if (n == 0) return;
+        f.offset += n;
+
+        // Whole lines go to the matcher; the rest waits for its newline
+        char* data = buf_.data();
+        const char* last_nl = static_cast<const char*>(memrchr(data, '\n', n));
+        if (!last_nl) {
+            f.carry.append(data, n);
+            continue;
+        }
+        size_t whole = last_nl + 1 - data;
+        if (f.carry.empty()) {
+            feed(f, data, whole);
+        } else {
+            f.carry.append(data, whole);
+            feed(f, f.carry.data(), f.carry.size());
+            f.carry.clear();
+        }
+        f.carry.append(data + whole, n - whole);
+    }
+}
+
+// Hand `size` bytes of whole lines (or a file's last line) to f's Grep,
+// in place
+void Follower::feed(File& f, char* data, size_t size) {
+    Buffer b;
+    b.data = data;
+    b.capacity = size;
+    b.size = size;
+    f.grep->feed(b);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <memory>
+#include <ostream>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "grep.h"
+
+// Watches files for appended lines and prints those that match (--follow).
+// Following starts at the current end of each file and only reads what is
+// appended afterwards, carrying a partial last line until its newline
+// arrives. A file renamed away keeps being read until a new file appears
+// under its name (rotation), which is then followed from its start; a file
+// truncated in place is followed from its new start. Files are watched
+// through inotify on their directories, with a periodic recheck as backup.
+class Follower {
+public:
+    Follower(Matcher& matcher, const GrepOptions& options, Stats& stats, std::ostream& out);
+    ~Follower();
+
+    Follower(const Follower&) = delete;
+    Follower& operator=(const Follower&) = delete;
+
+    // Follow `path`; if it does not exist yet it is picked up, from its
+    // start, once it appears. `label` prefixes its lines when set.
+    void add(const char* path, const char* label);
+
+    // Print matching lines as they are appended; never returns
+    void run();
+
+private:
+    struct File {
+        std::string path;
+        std::string name; // within the watched directory
+        const char* label;
+        int watch = -1;
+        int fd = -1;
+        dev_t dev = 0;
+        ino_t ino = 0;
+        off_t offset = 0;
+        std::string carry; // partial last line
+        std::unique_ptr<Grep> grep;
+    };
+
+    bool open_file(File& f);
+    void check(File& f);
+    void read_appended(File& f);
+    void feed(File& f, char* data, size_t size);
+    void close_file(File& f);
+
+    Matcher& matcher_;
+    GrepOptions options_;
+    Stats& stats_;
+    std::ostream& out_;
+    int inotify_;
+    std::vector<std::unique_ptr<File>> files_;
+    std::vector<char> buf_;
+};
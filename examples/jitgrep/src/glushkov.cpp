@@ -0,0 +1,104 @@
+#include "glushkov.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+struct Fragment {
+    bool nullable = true;
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> last;
+};
+
+void append(std::vector<uint32_t>& to, const std::vector<uint32_t>& from) {
+    to.insert(to.end(), from.begin(), from.end());
+}
+
+class Builder {
+public:
+    Builder(Glushkov& g, uint32_t pattern) : g_(g), pattern_(pattern) {}
+
+    Fragment build(const Node* node) {
+        Fragment f;
+        if (!node) return f; // empty branch
+        switch (node->type) {
+            case NODE_CHAR:
+                return position((unsigned char)static_cast<const CharNode*>(node)->c);
+            case NODE_ANY:
+                return position(SYM_ANY);
+            case NODE_START:
+                return position(SYM_BOL);
+            case NODE_END:
+                return position(SYM_EOL);
+            case NODE_CONCAT: {
+                auto* concat = static_cast<const ConcatNode*>(node);
+                Fragment l = build(concat->left.get());
+                Fragment r = build(concat->right.get());
+                for (uint32_t p : l.last) append(g_.follow[p], r.first);
+                f.nullable = l.nullable && r.nullable;
+                f.first = l.first;
+                if (l.nullable) append(f.first, r.first);
+                f.last = r.last;
+                if (r.nullable) append(f.last, l.last);
+                return f;
+            }
+            case NODE_STAR: {
+                // A lazy star matches the same lines; a possessive one may not
+                if (static_cast<const StarNode*>(node)->mode == STAR_POSSESSIVE) break;
+                f = build(static_cast<const StarNode*>(node)->child.get());
+                for (uint32_t p : f.last) append(g_.follow[p], f.first);
+                f.nullable = true;
+                return f;
+            }
+            case NODE_OR: {
+                auto* alt = static_cast<const OrNode*>(node);
+                Fragment l = build(alt->left.get());
+                Fragment r = build(alt->right.get());
+                f.nullable = l.nullable || r.nullable;
+                f.first = std::move(l.first);
+                append(f.first, r.first);
+                f.last = std::move(l.last);
+                append(f.last, r.last);
+                return f;
+            }
+            case NODE_GROUP:
+                return build(static_cast<const GroupNode*>(node)->child.get());
+            case NODE_ATOMIC:
+                break;
+        }
+        throw std::runtime_error("possessive stars and atomic groups need the backtracking engine");
+    }
+
+private:
+    Fragment position(uint16_t sym) {
+        uint32_t p = (uint32_t)g_.symbol.size();
+        g_.symbol.push_back(sym);
+        g_.pattern.push_back(pattern_);
+        g_.last.push_back(false);
+        g_.follow.emplace_back();
+        Fragment f;
+        f.nullable = false;
+        f.first.push_back(p);
+        f.last.push_back(p);
+        return f;
+    }
+
+    Glushkov& g_;
+    uint32_t pattern_;
+};
+
+} // namespace
+
+Glushkov::Glushkov(const std::vector<std::shared_ptr<Node>>& roots) : patterns(roots.size()) {
+    for (uint32_t i = 0; i < roots.size(); i++) {
+        Fragment f = Builder(*this, i).build(roots[i].get());
+        if (f.nullable) nullable.push_back(i);
+        append(first, f.first);
+        for (uint32_t p : f.last) last[p] = true;
+    }
+    std::sort(first.begin(), first.end());
+    for (auto& set : follow) {
+        std::sort(set.begin(), set.end());
+        set.erase(std::unique(set.begin(), set.end()), set.end());
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "regex.h"
+
+// Symbols beyond the byte range. Every line is read as BOL, its bytes, EOL,
+// so ^ and $ become ordinary positions that match only those sentinels.
+enum : uint16_t {
+    SYM_BOL = 256,
+    SYM_EOL = 257,
+    SYM_ANY = 258 // any byte but '\n'
+};
+
+// The Glushkov position automaton of a set of patterns: one state per
+// symbol occurrence ("position") in the patterns, no epsilon transitions.
+// Position p is entered on symbol[p] from the start or from any position
+// whose follow set contains p.
+struct Glushkov {
+    std::vector<uint16_t> symbol;              // per position
+    std::vector<uint32_t> pattern;             // per position: pattern index
+    std::vector<bool> last;                    // per position: ends a match
+    std::vector<std::vector<uint32_t>> follow; // per position, sorted
+    std::vector<uint32_t> first;               // entered from the start, sorted
+    std::vector<uint32_t> nullable;            // patterns matching the empty string
+    size_t patterns = 0;
+
+    // A null root is the empty pattern
+    explicit Glushkov(const std::vector<std::shared_ptr<Node>>& roots);
+
+    bool matches(uint32_t position, uint16_t sym) const {
+        uint16_t s = symbol[position];
+        return s == sym || (s == SYM_ANY && sym < 256 && sym != '\n');
+    }
+};
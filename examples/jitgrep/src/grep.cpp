@@ -0,0 +1,180 @@
+#include "grep.h"
+#include "newlines.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using Clock = std::chrono::steady_clock;
+
+Grep::Grep(Matcher& matcher, const GrepOptions& options, Stats& stats, std::ostream& out)
+    : matcher_(matcher), options_(options), stats_(stats), out_(out),
+      context_(options.context), count_lines_(options.context || options.line_numbers) {}
+
+void Grep::start(const char* label) {
+    label_ = label;
+    line_ = 0;
+    unprinted_ = 0;
+    file_printed_ = false;
+    after_left_ = 0;
+    finish();
+}
+
+void Grep::run(int fd, const char* label) {
+    start(label);
+
+    // Input is read (and decompressed) ahead on a separate thread; each
+    // buffer holds whole lines
+    AsyncReader reader(fd);
+    for (;;) {
+        auto wait_start = Clock::now();
+        Buffer* buf = reader.next();
+        stats_.io_wait_ms += ms_since(wait_start);
+        if (!buf) break;
+        feed(*buf);
+        reader.release(buf);
+    }
+    finish();
+}
+
+void Grep::feed(const Buffer& buf) {
+    buffer_ = &buf;
+    scan(buf);
+    if (options_.before) keep_before(buf);
+    buffer_ = nullptr;
+    out_.flush();
+}
+
+void Grep::finish() {
+    kept_base_ += kept_.size();
+    kept_.clear();
+    kept_lines_.clear();
+}
+
+// Copy out of `buf` the lines that before-context of a later match may
+// still reach: the last -B lines, back to the last line printed
+void Grep::keep_before(const Buffer& buf) {
+    uint64_t want = std::min<uint64_t>(options_.before, line_ - unprinted_);
+    const char* start = buf.data;
+    const char* end = buf.data + buf.size;
+    // Only the last buffer of an input lacks a final '\n'
+    if (want == 0 || end == start || end[-1] != '\n') {
+        finish();
+        return;
+    }
+
+    spans_.clear();
+    const char* pos = end;
+    while (spans_.size() < want && pos > start) {
+        const char* eol = pos - 1;
+        const char* sol = static_cast<const char*>(memrchr(start, '\n', eol - start));
+        sol = sol ? sol + 1 : start;
+        spans_.emplace_back(sol, eol);
+        pos = sol;
+    }
+
+    // Older lines make up what this buffer lacks
+    while (kept_lines_.size() > want - spans_.size()) kept_lines_.pop_front();
+    if (kept_lines_.empty()) {
+        finish();
+    } else if (kept_lines_.front() - kept_base_ > kept_.size() / 2) {
+        size_t dropped = kept_lines_.front() - kept_base_;
+        kept_.erase(0, dropped);
+        kept_base_ += dropped;
+    }
+
+    uint64_t base = kept_base_ + kept_.size();
+    for (auto it = spans_.rbegin(); it != spans_.rend(); ++it) kept_lines_.push_back(base + (it->first - pos));
+    kept_.append(pos, end);
+}
+
+void Grep::scan(const Buffer& buf) {
+    const char* p = buf.data;
+    const char* end = buf.data + buf.size;
+    stats_.bytes_scanned += buf.size;
+    if (options_.count_lines && buf.size) {
+        stats_.lines_scanned += count_newlines(p, end) + (end[-1] != '\n');
+    }
+
+    while (p < end) {
+        // After-context goes line by line, as any of those lines may match
+        if (after_left_) {
+            const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!eol) eol = end;
+            const char* next = eol < end ? eol + 1 : end;
+            bool match = matcher_.find(p, next) != next;
+            print_line(p, eol, match);
+            after_left_ = match ? options_.after : after_left_ - 1;
+            p = next;
+            continue;
+        }
+
+        // The matcher skips over whole runs of non-matching lines; only
+        // matches need their line boundaries
+        const char* hit = matcher_.find(p, end);
+        if (hit == end) {
+            if (count_lines_) line_ += count_newlines(p, end) + (end[-1] != '\n');
+            break;
+        }
+
+        const char* bol = static_cast<const char*>(memrchr(p, '\n', hit - p));
+        bol = bol ? bol + 1 : p;
+        const char* eol = static_cast<const char*>(memchr(hit, '\n', end - hit));
+        if (!eol) eol = end;
+
+        if (count_lines_) line_ += count_newlines(p, bol);
+        if (context_) {
+            uint64_t before = std::min<uint64_t>(options_.before, line_ - unprinted_);
+            start_group(line_ - before);
+            print_before(bol, before);
+            after_left_ = options_.after;
+        }
+        print_line(bol, eol, true);
+        p = eol + 1;
+    }
+}
+
+// Print "--" between groups of lines that are not adjacent
+void Grep::start_group(uint64_t first_line) {
+    if (printed_ && (!file_printed_ || first_line > unprinted_)) out_ << "--\n";
+}
+
+// Print the `count` lines before `bol`, the oldest of which may have been
+// kept from earlier buffers
+void Grep::print_before(const char* bol, uint64_t count) {
+    spans_.clear();
+    const char* start = buffer_->data;
+    const char* pos = bol;
+    while (spans_.size() < count && pos > start) {
+        const char* eol = pos - 1;
+        const char* sol = static_cast<const char*>(memrchr(start, '\n', eol - start));
+        sol = sol ? sol + 1 : start;
+        spans_.emplace_back(sol, eol);
+        pos = sol;
+    }
+    line_ -= count;
+    for (size_t i = kept_lines_.size() - (count - spans_.size()); i < kept_lines_.size(); i++) {
+        size_t sol = kept_lines_[i] - kept_base_;
+        size_t eol = (i + 1 < kept_lines_.size() ? kept_lines_[i + 1] - kept_base_ : kept_.size()) - 1;
+        print_line(kept_.data() + sol, kept_.data() + eol, false);
+    }
+    for (auto it = spans_.rbegin(); it != spans_.rend(); ++it) {
+        print_line(it->first, it->second, false);
+    }
+}
+
+void Grep::print_line(const char* bol, const char* eol, bool match) {
+    if (match) stats_.lines_matched++;
+    if (label_) out_ << label_ << (match ? ':' : '-');
+    if (options_.line_numbers) out_ << line_ + 1 << (match ? ':' : '-');
+    if (match && options_.ids) {
+        matcher_.pattern_ids(bol, eol, ids_);
+        for (size_t i = 0; i < ids_.size(); i++) {
+            out_ << (i ? "," : "") << ids_[i] + 1;
+        }
+        out_ << ':';
+    }
+    out_.write(bol, eol - bol).put('\n');
+    line_++;
+    unprinted_ = line_;
+    printed_ = file_printed_ = true;
+}
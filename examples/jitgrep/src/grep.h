@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "matcher.h"
+#include "reader.h"
+#include "stats.h"
+
+// How matches are printed
+struct GrepOptions {
+    bool ids = false;         // prefix pattern numbers (--ids)
+    size_t before = 0;        // lines of context before a match (-B)
+    size_t after = 0;         // lines of context after a match (-A)
+    bool context = false;     // any of -A/-B/-C given, if only as 0
+    bool line_numbers = false; // prefix line numbers (-n)
+    bool count_lines = false; // count scanned lines for --stats
+};
+
+// Runs a matcher over input and prints the matching lines, with context.
+// Context lines are printed straight from the input buffers. Before a buffer
+// goes back to the reader, the last unprinted lines before-context may
+// still need are copied out of it, so memory follows the lines kept rather
+// than -B times the buffer size. Line numbers, when needed, are only
+// counted in the stretches between matches, with SIMD.
+class Grep {
+public:
+    Grep(Matcher& matcher, const GrepOptions& options, Stats& stats, std::ostream& out);
+
+    // Print the lines of `fd` that match; `label` prefixes them when set
+    void run(int fd, const char* label);
+
+    // The same in steps, for input that arrives piecemeal (--follow):
+    // start() an input, feed() it buffers of whole lines as they come, and
+    // finish() it. A buffer is no longer needed once feed() returns.
+    void start(const char* label);
+    void feed(const Buffer& buf);
+    void finish();
+
+private:
+    void scan(const Buffer& buf);
+    void keep_before(const Buffer& buf);
+    void print_before(const char* bol, uint64_t count);
+    void print_line(const char* bol, const char* eol, bool match);
+    void start_group(uint64_t first_line);
+
+    Matcher& matcher_;
+    GrepOptions options_;
+    Stats& stats_;
+    std::ostream& out_;
+    bool context_;
+    bool count_lines_; // keep line_ up to date
+    bool printed_ = false; // any group printed so far, in any file
+
+    // Per input
+    const char* label_ = nullptr;
+    const Buffer* buffer_ = nullptr; // being scanned
+    std::string kept_;          // unprinted lines before it, for -B
+    std::deque<uint64_t> kept_lines_; // start of each, counting from kept_base_
+    uint64_t kept_base_ = 0;    // bytes dropped from the front of kept_
+    uint64_t line_ = 0;         // number of the line being looked at
+    uint64_t unprinted_ = 0;    // first line after the last one printed
+    bool file_printed_ = false;
+    size_t after_left_ = 0;
+
+    std::vector<uint32_t> ids_;
+    std::vector<std::pair<const char*, const char*>> spans_;
+};
@@ -1,186 +1,223 @@
 #include "jit.h"
-#include <sys/mman.h>
-#include <unistd.h>
+#include "code_arena.h"
+#include "code_emitter.h"
 #include <cstring>
 #include <iostream>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <numeric>
 #include <cassert>
+#include <cstdio>
 
-// Simple x64 Assembler helper
-class CodeEmitter {
-    std::vector<uint8_t> code;
-    // Map from label_id to list of locations that point to it (patch sites)
-    std::map<int, std::vector<size_t>> label_patches;
-    // Map from label_id to resolved definition location
-    std::map<int, size_t> label_defs;
-    int next_label_id = 1;
-
-public:
-    void* get_code() {
-        return code.data();
-    }
-    
-    size_t size() { return code.size(); }
+struct JIT::Impl {
+    CodeEmitter emit;
+    void* exec_mem = nullptr;
+    size_t exec_size = 0;
 
-    int alloc_label() { return next_label_id++; }
+    // Shared failure path: resume at the most recent backtrack frame
+    int fail = 0;
 
-    void emit_byte(uint8_t b) {
-        code.push_back(b);
-    }
-    
-    void emit_bytes(const std::vector<uint8_t>& bytes) {
-        code.insert(code.end(), bytes.begin(), bytes.end());
-    }
-    
-    void emit_u32(uint32_t val) {
-        code.push_back(val & 0xFF);
-        code.push_back((val >> 8) & 0xFF);
-        code.push_back((val >> 16) & 0xFF);
-        code.push_back((val >> 24) & 0xFF);
+    // Instrumented variant: every backtrack frame push bumps this counter
+    bool count_frames = false;
+    uint64_t frames_pushed = 0;
+
+    // Per-alternative counters (profile_branches) and the order to try
+    // alternatives in
+    bool profile_branches = false;
+    BranchProfile branch_hits;
+    const BranchProfile* branch_order = nullptr;
+
+    // Stack slots below rbp, 8 bytes each: saved positions for stars whose
+    // child can match empty, and saved stack pointers for atomic groups
+    int32_t slots = 0;
+
+    // Atomic groups and possessive stars being compiled
+    int atomic_depth = 0;
+
+    // With captures, the first 2 * groups slots hold where each group
+    // started and ended
+    bool captures = false;
+    int groups = 0;
+
+    // Nodes being compiled, innermost last, and the code regions they own
+    std::vector<const Node*> node_stack;
+    std::vector<CodeRegion> regions;
+
+    ~Impl() {
+        if (exec_mem) {
+            CodeArena::instance().release(exec_mem, exec_size);
+        }
     }
 
-    // Call definition of a label (current location)
-    void label(int id) {
-        label_defs[id] = code.size();
-        if (label_patches.count(id)) {
-            for (size_t loc : label_patches[id]) {
-                // Calculate relative offset
-                // rel32 = target - (loc + 4)
-                int32_t rel = (int32_t)(code.size() - (loc + 4));
-                // Patch
-                code[loc] = rel & 0xFF;
-                code[loc+1] = (rel >> 8) & 0xFF;
-                code[loc+2] = (rel >> 16) & 0xFF;
-                code[loc+3] = (rel >> 24) & 0xFF;
-            }
-            label_patches.erase(id);
+    // Push a backtrack frame: resume address, then the current position
+    void push_frame(int resume_label) {
+        emit.emit_lea_rip(resume_label);
+        emit.push_rax();
+        emit.push_rdi();
+        if (count_frames) {
+            emit.mov_r11_imm64((uint64_t)&frames_pushed);
+            emit.inc_ptr_r11();
         }
     }
 
-    // Emit JMP/Jcc to label (32-bit relative)
-    // Opcode is the byte(s) for the jump instruction before the immediate
-    void emit_jump(std::vector<uint8_t> opcode, int target_label) {
-        emit_bytes(opcode);
-        size_t patch_loc = code.size();
-        emit_u32(0); // placeholder
-        
-        if (label_defs.count(target_label)) {
-            // Already defined
-            int32_t rel = (int32_t)(label_defs[target_label] - (patch_loc + 4));
-            code[patch_loc] = rel & 0xFF;
-            code[patch_loc+1] = (rel >> 8) & 0xFF;
-            code[patch_loc+2] = (rel >> 16) & 0xFF;
-            code[patch_loc+3] = (rel >> 24) & 0xFF;
-        } else {
-            label_patches[target_label].push_back(patch_loc);
+    static bool nullable(const Node* node) {
+        if (!node) return true;
+        switch (node->type) {
+            case NODE_CHAR:
+            case NODE_ANY:
+                return false;
+            case NODE_CONCAT: {
+                auto* n = static_cast<const ConcatNode*>(node);
+                return nullable(n->left.get()) && nullable(n->right.get());
+            }
+            case NODE_OR: {
+                auto* n = static_cast<const OrNode*>(node);
+                return nullable(n->left.get()) || nullable(n->right.get());
+            }
+            case NODE_ATOMIC:
+                return nullable(static_cast<const AtomicNode*>(node)->child.get());
+            case NODE_GROUP:
+                return nullable(static_cast<const GroupNode*>(node)->child.get());
+            default:
+                return true; // stars and anchors
         }
     }
 
-    // LEA rax, [rip + label]
-    void emit_lea_rip(int target_label) {
-        // 48 8D 05 xx xx xx xx
-        emit_bytes({0x48, 0x8D, 0x05});
-        size_t patch_loc = code.size();
-        emit_u32(0);
-
-        if (label_defs.count(target_label)) {
-             int32_t rel = (int32_t)(label_defs[target_label] - (patch_loc + 4));
-             // patch logic (extracted)
-             code[patch_loc] = rel & 0xFF;
-             code[patch_loc+1] = (rel >> 8) & 0xFF;
-             code[patch_loc+2] = (rel >> 16) & 0xFF;
-             code[patch_loc+3] = (rel >> 24) & 0xFF;
-        } else {
-            label_patches[target_label].push_back(patch_loc);
+    // Slots needed by `node` and its descendants
+    static int32_t count_slots(const Node* node) {
+        if (!node) return 0;
+        switch (node->type) {
+            case NODE_CONCAT: {
+                auto* n = static_cast<const ConcatNode*>(node);
+                return count_slots(n->left.get()) + count_slots(n->right.get());
+            }
+            case NODE_OR: {
+                auto* n = static_cast<const OrNode*>(node);
+                return count_slots(n->left.get()) + count_slots(n->right.get());
+            }
+            case NODE_STAR: {
+                auto* n = static_cast<const StarNode*>(node);
+                return nullable(n->child.get()) + (n->mode == STAR_POSSESSIVE) + count_slots(n->child.get());
+            }
+            case NODE_ATOMIC:
+                return 1 + count_slots(static_cast<const AtomicNode*>(node)->child.get());
+            case NODE_GROUP:
+                return count_slots(static_cast<const GroupNode*>(node)->child.get());
+            default:
+                return 0;
         }
     }
 
-    // --- Instructions ---
+    // Offset from rbp of the next free slot
+    int32_t alloc_slot() {
+        return -8 * ++slots;
+    }
 
-    void push_rdi() { emit_byte(0x57); }
-    void pop_rdi() { emit_byte(0x5F); }
-    void push_rax() { emit_byte(0x50); }
-    void push_rbp() { emit_byte(0x55); }
-    void pop_rbp() { emit_byte(0x5D); }
-    void ret() { emit_byte(0xC3); }
-    
-    // mov rsp, rbp
-    void mov_rsp_rbp() { emit_bytes({0x48, 0x89, 0xEC}); }
-    
-    // mov rbp, rsp
-    void mov_rbp_rsp() { emit_bytes({0x48, 0x89, 0xE5}); }
+    // Push a frame that puts back the current value of `slot` when
+    // backtracking passes this point
+    void preserve_slot(int32_t slot) {
+        int restore = emit.alloc_label();
+        int done = emit.alloc_label();
+        emit.emit_lea_rip(restore);
+        emit.push_rax();
+        emit.push_slot(slot);
+        emit.jmp(done);
+        emit.label(restore); // the shared failure path popped the old value into rdi
+        emit.mov_slot_rdi(slot);
+        emit.jmp(fail);
+        emit.label(done);
+    }
 
-    // mov rax, imm64 (simplified to imm32 for 0/1)
-    void mov_rax_0() { emit_bytes({0x48, 0xC7, 0xC0, 0x00, 0x00, 0x00, 0x00}); }
-    void mov_rax_1() { emit_bytes({0x48, 0xC7, 0xC0, 0x01, 0x00, 0x00, 0x00}); }
-    // inc rdi
-    void inc_rdi() { emit_bytes({0x48, 0xFF, 0xC7}); }
+    // Store the position in `slot`, preserving the old value, so that each
+    // iteration of an enclosing loop sees its own value again
+    void save_position(int32_t slot) {
+        preserve_slot(slot);
+        emit.mov_slot_rdi(slot);
+    }
 
-    // mov al, [rdi]
-    void mov_al_ptr_rdi() { emit_bytes({0x8A, 0x07}); }
+    // Slot of where group `index` starts (or ends)
+    static int32_t group_slot(int index, bool end) {
+        return -8 * (2 * index - 1 + end);
+    }
 
-    // cmp al, imm8
-    void cmp_al(uint8_t val) { emit_bytes({0x3C, val}); }
-    
-    // cmp byte ptr [rdi], imm8
-    void cmp_ptr_rdi(uint8_t val) { emit_bytes({0x80, 0x3F, val}); }
+    // Atomic constructs drop the frames their child pushed, including those
+    // that would restore the groups it set. Frames pushed beforehand restore
+    // them instead if a later failure backtracks past the construct.
+    void preserve_groups() {
+        for (int i = 1; i <= groups; i++) {
+            preserve_slot(group_slot(i, false));
+            preserve_slot(group_slot(i, true));
+        }
+    }
 
-    // je label
-    void je(int label) { emit_jump({0x0F, 0x84}, label); }
-    
-    // jne label
-    void jne(int label) { emit_jump({0x0F, 0x85}, label); }
-    
-    // jmp label
-    void jmp(int label) { emit_jump({0xE9}, label); }
-    
-    // cmp rdi, rsi (compare pointers)
-    void cmp_rdi_rsi() { emit_bytes({0x48, 0x39, 0xF7}); }
-};
+    // The alternatives of the chain a|b|c topped by `node`, in pattern order
+    static void collect_branches(const std::shared_ptr<Node>& node, std::vector<std::shared_ptr<Node>>& branches) {
+        if (node && node->type == NODE_OR) {
+            auto n = std::static_pointer_cast<OrNode>(node);
+            collect_branches(n->left, branches);
+            collect_branches(n->right, branches);
+        } else {
+            branches.push_back(node);
+        }
+    }
 
-struct JIT::Impl {
-    CodeEmitter emit;
-    void* exec_mem = nullptr;
-    size_t exec_size = 0;
+    // Indices of `count` alternatives of `chain` in the order to try them:
+    // most frequent match first, pattern order among equals
+    std::vector<size_t> branch_sequence(const Node* chain, size_t count) {
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+        if (branch_order && !atomic_depth) {
+            auto it = branch_order->find(chain);
+            if (it != branch_order->end() && it->second.size() == count) {
+                const std::vector<uint64_t>& hits = it->second;
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return hits[a] > hits[b]; });
+            }
+        }
+        return order;
+    }
 
-    ~Impl() {
-        if (exec_mem) {
-            munmap(exec_mem, exec_size);
+    // Attribute code emitted from here on to the innermost open node
+    void mark_region() {
+        const Node* n = node_stack.empty() ? nullptr : node_stack.back();
+        size_t here = emit.size();
+        if (!regions.empty() && regions.back().offset == here) regions.pop_back();
+        if (!regions.empty()) {
+            CodeRegion& last = regions.back();
+            last.size = here - last.offset;
+            if (last.glue == !n && (!n || (last.src_begin == n->begin && last.src_end == n->end))) {
+                return; // same node as before: keep extending its region
+            }
         }
+        regions.push_back({here, 0, n ? n->begin : 0, n ? n->end : 0, !n});
     }
 
     void compile_node(std::shared_ptr<Node> node) {
+        if (!node) return; // empty branch, as in a| or ()
+        node_stack.push_back(node.get());
+        mark_region();
+        compile_node_body(node);
+        node_stack.pop_back();
+        mark_region();
+    }
+
+    void compile_node_body(std::shared_ptr<Node> node) {
         switch (node->type) {
             case NODE_CHAR: {
                 auto n = std::static_pointer_cast<CharNode>(node);
-                // cmp byte ptr [rdi], c
+                emit.cmp_rdi_rdx();
+                emit.jae(fail);
                 emit.cmp_ptr_rdi((uint8_t)n->c);
-                int fail = emit.alloc_label();
-                int success = emit.alloc_label();
-                emit.je(success);
-                // check for fail
-                emit.label(fail);
-                emit.pop_rdi();
-                emit.ret(); // Backtrack
-                
-                emit.label(success);
+                emit.jne(fail);
                 emit.inc_rdi();
                 break;
             }
             case NODE_ANY: {
-                // . matches anything except \0? (Usually matches everything except newline, but simple grep matches anything except \0 usually?)
-                // Let's implement . does not match \0 (end of string).
-                emit.cmp_ptr_rdi(0);
-                int fail = emit.alloc_label();
-                int success = emit.alloc_label();
-                emit.jne(success);
-                
-                emit.label(fail);
-                emit.pop_rdi();
-                emit.ret();
-                
-                emit.label(success);
+                // . matches any byte but '\n', NUL included
+                emit.cmp_rdi_rdx();
+                emit.jae(fail);
+                emit.cmp_ptr_rdi('\n');
+                emit.je(fail);
                 emit.inc_rdi();
                 break;
             }
@@ -191,134 +228,152 @@ struct JIT::Impl {
                 break;
             }
             case NODE_OR: {
-                auto n = std::static_pointer_cast<OrNode>(node);
-                // push backtrack(B)
-                int label_B = emit.alloc_label();
+                // A chain a|b|c is compiled as one n-way choice: push a
+                // frame resuming at the next alternative, try this one,
+                // and on success skip the rest. Frames left behind let a
+                // later failure come back and try the next alternative.
+                std::vector<std::shared_ptr<Node>> branches;
+                collect_branches(node, branches);
+                uint64_t* hits = nullptr;
+                if (profile_branches) {
+                    hits = branch_hits.emplace(node.get(), std::vector<uint64_t>(branches.size())).first->second.data();
+                }
+
                 int label_end = emit.alloc_label();
-                
-                emit.emit_lea_rip(label_B);
-                emit.push_rax();
-                emit.push_rdi(); // save valid state
-                
-                compile_node(n->left);
-                
-                // If A succeeds, we need to skip B's part?
-                // Wait. As analyzed, if A succeeds, we just flow through. 
-                // But the backtrack stack still has "Try B". 
-                // That is correct. If later A fails, we pop back to B.
-                // We do NOT jump to label_end effectively skipping B logic from *execution flow*.
-                // Wait. Logic check:
-                // Flow: Setup B -> Run A -> continue.
-                // If A fails (internally): it pops [rdi, label_B] and jumps to label_B.
-                // So at label_B we are in the failure path of A.
-                
-                // But wait, if A succeeds, we continue execution.
-                // We should NOT encounter `label_B` during normal flow.
-                // So we need to JUMP over it.
-                // But `label_B` is a target address, not a block of code? 
-                // Ah, `label_B` is where the CODE for B starts.
-                
-                // Oops.
-                // [Setup Backtrack B]
-                // [Code for A] -- if success, falls through.
-                // JMP End -- If A succeeds, we skip trying B *now*.
-                
-                // label_B:
-                //   pop rdi
-                //   [Code for B]
-                
-                // End:
-                //   continue
-                
-                // Re-verification:
-                // If A succeeds, we jump to End. Stack has [B].
-                // If subsequent nodes fail, they pop [B] and jump to label_B. Correct.
-                
-                emit.jmp(label_end);
-                
-                emit.label(label_B);
-                // emit.pop_rdi(); // REMOVED: Stack is clean, RDI is restored by fail handler
-                compile_node(n->right);
-                
+                std::vector<size_t> order = branch_sequence(node.get(), branches.size());
+                for (size_t i = 0; i < order.size(); i++) {
+                    bool last = i + 1 == order.size();
+                    int label_next = emit.alloc_label();
+                    if (!last) push_frame(label_next);
+                    compile_node(branches[order[i]]);
+                    if (hits) {
+                        emit.mov_r11_imm64((uint64_t)&hits[order[i]]);
+                        emit.inc_ptr_r11();
+                    }
+                    if (!last) {
+                        emit.jmp(label_end);
+                        emit.label(label_next);
+                    }
+                }
                 emit.label(label_end);
                 break;
             }
             case NODE_STAR: {
                 auto n = std::static_pointer_cast<StarNode>(node);
-                // Greedy loop
-                int loop_start = emit.alloc_label();
-                int next_alt = emit.alloc_label();
-                
-                emit.label(loop_start);
-                // Push backtrack to next_alt (Done)
-                emit.emit_lea_rip(next_alt);
-                emit.push_rax();
-                emit.push_rdi();
-                
+                if (n->mode == STAR_POSSESSIVE) {
+                    // x*+ is (?>x*)
+                    if (captures) preserve_groups();
+                    int32_t mark = alloc_slot();
+                    emit.mov_slot_rsp(mark);
+                    atomic_depth++;
+                    compile_star(n);
+                    atomic_depth--;
+                    emit.mov_rsp_slot(mark);
+                } else {
+                    compile_star(n);
+                }
+                break;
+            }
+            case NODE_ATOMIC: {
+                // Drop every frame the child pushed once it has matched, by
+                // resetting rsp to where it was on entry
+                auto n = std::static_pointer_cast<AtomicNode>(node);
+                if (captures) preserve_groups();
+                int32_t mark = alloc_slot();
+                emit.mov_slot_rsp(mark);
+                atomic_depth++;
+                compile_node(n->child);
+                atomic_depth--;
+                emit.mov_rsp_slot(mark);
+                break;
+            }
+            case NODE_GROUP: {
+                auto n = std::static_pointer_cast<GroupNode>(node);
+                if (captures) save_position(group_slot(n->index, false));
                 compile_node(n->child);
-                // If child succeeds, loop back
-                emit.jmp(loop_start);
-                
-                emit.label(next_alt); // This is the backtrack target (Exit loop)
-                // emit.pop_rdi(); // REMOVED: Stack is clean, RDI is restored
-                // Fall through to rest
+                if (captures) save_position(group_slot(n->index, true));
                 break;
             }
             case NODE_START: {
-                // check rdi == rsi
                 emit.cmp_rdi_rsi();
-                int fail = emit.alloc_label();
-                int success = emit.alloc_label();
-                emit.je(success);
-                
-                emit.label(fail);
-                emit.pop_rdi();
-                emit.ret();
-                
-                emit.label(success);
+                emit.jne(fail);
                 break;
             }
             case NODE_END: {
-                // check [rdi] == 0 or \n (depending on line)
-                // Assuming null terminated string as input for line
-                emit.cmp_ptr_rdi(0);
-                int fail = emit.alloc_label();
+                // $ matches at the end of input or before '\n'
                 int success = emit.alloc_label();
-                emit.je(success);
-                
-                emit.label(fail);
-                emit.pop_rdi();
-                emit.ret();
-                
+                emit.cmp_rdi_rdx();
+                emit.jae(success);
+                emit.cmp_ptr_rdi('\n');
+                emit.jne(fail);
                 emit.label(success);
                 break;
             }
         }
     }
     
-    void finalize() {
-        // Allocate executable memory
-        exec_size = emit.size();
-        FILE* f = fopen("jit_dump.bin", "wb");
-        if(f) { fwrite(emit.get_code(), 1, exec_size, f); fclose(f); }
+    // A greedy loop pushes a frame that exits the loop before each
+    // iteration, so failure gives back one iteration at a time; a lazy one
+    // pushes a frame that runs one more iteration before trying the rest.
+    // An iteration that matches empty ends the loop (greedy) or fails
+    // (lazy), so a child like (a*) cannot spin forever.
+    void compile_star(const std::shared_ptr<StarNode>& n) {
+        int32_t start = nullable(n->child.get()) ? alloc_slot() : 0;
+        int loop = emit.alloc_label();
+        int iterate = emit.alloc_label();
+        int done = emit.alloc_label();
 
-        exec_mem = mmap(nullptr, exec_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);        if (exec_mem == MAP_FAILED) {
-            perror("mmap");
-            return;
+        emit.label(loop);
+        if (n->mode == STAR_LAZY) {
+            push_frame(iterate);
+            emit.jmp(done);
+            emit.label(iterate);
+        } else {
+            push_frame(done);
         }
-        memcpy(exec_mem, emit.get_code(), exec_size);
-        mprotect(exec_mem, exec_size, PROT_READ | PROT_EXEC);
+        if (start) save_position(start);
+        compile_node(n->child);
+        if (start) {
+            emit.cmp_rdi_slot(start);
+            emit.je(n->mode == STAR_LAZY ? fail : done);
+        }
+        emit.jmp(loop);
+        emit.label(done);
+    }
+
+    void finalize() {
+        // Executable memory comes from the shared arena; inside a
+        // CodeArena::Batch it becomes executable when the batch ends
+        exec_size = emit.size();
+        exec_mem = CodeArena::instance().add(emit.get_code(), exec_size);
     }
 };
 
 JIT::JIT() : impl(std::make_unique<Impl>()) {}
 JIT::~JIT() = default;
 
-void JIT::compile(std::shared_ptr<Node> root) {
+void JIT::compile(std::shared_ptr<Node> root, const JitOptions& options) {
+    impl->count_frames = options.count_frames;
+    impl->profile_branches = options.profile_branches;
+    impl->branch_order = options.branch_order;
+    impl->emit.keep_listing = options.listing;
+    impl->captures = options.captures;
+    impl->groups = options.captures ? group_count(root.get()) : 0;
+    impl->fail = impl->emit.alloc_label();
+    impl->mark_region();
+
     // Prologue
     impl->emit.push_rbp();
     impl->emit.mov_rbp_rsp();
-    
+    int32_t slots = 2 * impl->groups + Impl::count_slots(root.get());
+    if (slots) impl->emit.sub_rsp(8 * slots);
+    if (impl->captures) {
+        // Groups start out unset; rcx holds the captures array
+        impl->emit.mov_rax_0();
+        for (int32_t i = 0; i < 2 * impl->groups; i++) impl->emit.mov_slot_rax(impl->alloc_slot());
+        impl->emit.mov_rcx_ptr_rdi(0);
+    }
+
     // Global Fail Handler
     int global_fail = impl->emit.alloc_label();
     impl->emit.emit_lea_rip(global_fail);
@@ -326,11 +381,18 @@ void JIT::compile(std::shared_ptr<Node> root) {
     impl->emit.push_rdi(); // dummy rdi
     
     // Compile AST
-    if (root) {
-        impl->compile_node(root);
-    }
+    impl->compile_node(root);
     
     // Success (Machine code fell through all nodes)
+    if (impl->captures) {
+        impl->emit.mov_rcx_ptr_rdi(8);
+        for (int i = 1; i <= impl->groups; i++) {
+            impl->emit.mov_rax_slot(Impl::group_slot(i, false));
+            impl->emit.mov_rcx_ptr_rax(16 * i);
+            impl->emit.mov_rax_slot(Impl::group_slot(i, true));
+            impl->emit.mov_rcx_ptr_rax(16 * i + 8);
+        }
+    }
     // Return 1
     impl->emit.mov_rax_1();
     impl->emit.mov_rsp_rbp(); // Restore stack (clears backtrack stack)
@@ -345,13 +407,59 @@ void JIT::compile(std::shared_ptr<Node> root) {
     impl->emit.pop_rbp();
     impl->emit.ret();
     
+    // Shared failure path: pop the saved position, return to the resume
+    // address
+    impl->emit.label(impl->fail);
+    impl->emit.pop_rdi();
+    impl->emit.ret();
+
+    // Close the last region
+    impl->regions.back().size = impl->emit.size() - impl->regions.back().offset;
+    assert(impl->slots == slots);
+
     impl->finalize();
 }
 
-typedef bool (*match_func_t)(const char* text, const char* start);
+// rdi: current position, rsi: start of input, rdx: end of input, rcx:
+// captures (only used with JitOptions::captures)
+typedef bool (*match_func_t)(const char* text, const char* start, const char* end, const char** captures);
+
+bool JIT::execute(const char* text, const char* text_start, const char* text_end) {
+    if (!impl->exec_mem) return false;
+    auto func = (match_func_t)impl->exec_mem;
+    return func(text, text_start, text_end, nullptr);
+}
 
-bool JIT::execute(const char* text, const char* text_start) {
+bool JIT::execute(const char* text, const char* text_start, const char* text_end, const char** captures) {
     if (!impl->exec_mem) return false;
     auto func = (match_func_t)impl->exec_mem;
-    return func(text, text_start);
+    return func(text, text_start, text_end, captures);
+}
+
+const void* JIT::code() const {
+    return impl->exec_mem;
+}
+
+size_t JIT::code_size() const {
+    return impl->exec_size;
+}
+
+const std::vector<CodeRegion>& JIT::regions() const {
+    return impl->regions;
+}
+
+const std::vector<AsmLine>& JIT::listing() const {
+    return impl->emit.listing;
+}
+
+uint64_t JIT::frames_pushed() const {
+    return impl->frames_pushed;
+}
+
+void JIT::reset_frames_pushed() {
+    impl->frames_pushed = 0;
+}
+
+const BranchProfile& JIT::branch_hits() const {
+    return impl->branch_hits;
 }
@@ -1,21 +1,81 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <map>
 #include <string>
 #include <memory>
 #include "regex.h"
 
+// Per chain of alternatives a|b|c (keyed by its topmost OR node), one count
+// per alternative in pattern order
+using BranchProfile = std::map<const Node*, std::vector<uint64_t>>;
+
+struct JitOptions {
+    bool count_frames = false;     // count backtrack frame pushes
+    bool listing = false;          // keep an assembly listing of the code
+    bool profile_branches = false; // count how often each alternative matches
+    bool captures = false;         // report where matches end and groups matched
+
+    // Try alternatives in decreasing order of these counts, from the
+    // branch_hits() of an earlier compile of the same AST. Only valid
+    // while callers ask whether there is a match, not where or how.
+    // Alternatives inside atomic groups and possessive stars keep their
+    // order, as there it decides whether the pattern matches at all.
+    const BranchProfile* branch_order = nullptr;
+};
+
+// A run of generated code and the part of the pattern it was compiled from.
+// Glue code (prologue, epilogue) belongs to no node.
+struct CodeRegion {
+    size_t offset;
+    size_t size;
+    size_t src_begin;
+    size_t src_end;
+    bool glue;
+};
+
+// One instruction (or label definition, "L3:") of the assembly listing
+struct AsmLine {
+    size_t offset;
+    std::string text;
+};
+
 class JIT {
 public:
     JIT();
     ~JIT();
 
-    // Compile the AST into machine code
-    void compile(std::shared_ptr<Node> root);
+    // Compile the AST into machine code. Inside a CodeArena::Batch the code
+    // may only run once the batch has ended.
+    void compile(std::shared_ptr<Node> root, const JitOptions& options = JitOptions());
+
+    // Run the compiled code against the input [text_start, text_end)
+    // Returns true if match found at current position `text`. The input
+    // need not be terminated and may contain any bytes.
+    bool execute(const char* text, const char* text_start, const char* text_end);
+
+    // The same, for code compiled with JitOptions::captures: on a match,
+    // captures[2i] and captures[2i + 1] are where group i started and
+    // ended, group 0 being the whole match, or null for groups that took
+    // no part in it. `captures` holds 2 * (group_count(root) + 1) entries.
+    bool execute(const char* text, const char* text_start, const char* text_end, const char** captures);
+
+    // The generated code and its size in bytes
+    const void* code() const;
+    size_t code_size() const;
+
+    // Generated code split by the pattern node it came from, in address order
+    const std::vector<CodeRegion>& regions() const;
+
+    // Assembly listing (only kept with JitOptions::listing)
+    const std::vector<AsmLine>& listing() const;
+
+    // Backtrack frames pushed so far (only counted with count_frames)
+    uint64_t frames_pushed() const;
+    void reset_frames_pushed();
 
-    // Run the compiled code against input
-    // Returns true if match found at current position
-    bool execute(const char* text, const char* text_start);
+    // Matches of each alternative so far (only counted with profile_branches)
+    const BranchProfile& branch_hits() const;
 
 private:
     struct Impl;
@@ -0,0 +1,159 @@
+#include "jit_debug.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static std::string region_name(const CodeRegion& r, const std::string& pattern) {
+    if (r.glue) return "jitgrep:glue";
+    return "jitgrep:" + pattern.substr(r.src_begin, r.src_end - r.src_begin) + "@" +
+           std::to_string(r.src_begin);
+}
+
+static void fail(const std::string& what) {
+    throw std::runtime_error(what + ": " + strerror(errno));
+}
+
+void write_perf_map(const JIT& jit, const std::string& pattern) {
+    std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    FILE* f = fopen(path.c_str(), "a");
+    if (!f) fail(path);
+    auto base = reinterpret_cast<uintptr_t>(jit.code());
+    for (const auto& r : jit.regions()) {
+        fprintf(f, "%lx %zx %s\n", (unsigned long)(base + r.offset), r.size,
+                region_name(r, pattern).c_str());
+    }
+    fclose(f);
+}
+
+// Record layouts from perf's tools/perf/Documentation/jitdump-specification.txt
+struct JitdumpHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct JitdumpCodeLoad {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+static uint64_t monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void write_jitdump(const JIT& jit, const std::string& pattern) {
+    static FILE* dump = nullptr;
+    static uint64_t code_index = 0;
+
+    if (!dump) {
+        std::string path = "/tmp/jit-" + std::to_string(getpid()) + ".dump";
+        int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666);
+        if (fd < 0) fail(path);
+        // perf finds the dump through this executable mapping of it
+        if (mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0) ==
+            MAP_FAILED) {
+            fail(path);
+        }
+        dump = fdopen(fd, "w");
+        JitdumpHeader h = {0x4A695444, 1, sizeof(JitdumpHeader), 62 /* EM_X86_64 */,
+                           0, (uint32_t)getpid(), monotonic_ns(), 0};
+        fwrite(&h, sizeof(h), 1, dump);
+    }
+
+    auto base = reinterpret_cast<uintptr_t>(jit.code());
+    auto code = static_cast<const uint8_t*>(jit.code());
+    for (const auto& r : jit.regions()) {
+        std::string name = region_name(r, pattern);
+        JitdumpCodeLoad rec;
+        rec.id = 0; // JIT_CODE_LOAD
+        rec.total_size = (uint32_t)(sizeof(rec) + name.size() + 1 + r.size);
+        rec.timestamp = monotonic_ns();
+        rec.pid = (uint32_t)getpid();
+        rec.tid = (uint32_t)syscall(SYS_gettid);
+        rec.vma = rec.code_addr = base + r.offset;
+        rec.code_size = r.size;
+        rec.code_index = code_index++;
+        fwrite(&rec, sizeof(rec), 1, dump);
+        fwrite(name.c_str(), name.size() + 1, 1, dump);
+        fwrite(code + r.offset, r.size, 1, dump);
+    }
+    fflush(dump);
+}
+
+void write_code(const JIT& jit, const std::string& path) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) fail(path);
+    fwrite(jit.code(), 1, jit.code_size(), f);
+    fclose(f);
+}
+
+void print_listing(std::ostream& out, const JIT& jit, const std::string& pattern) {
+    const auto& lines = jit.listing();
+    const auto& regions = jit.regions();
+    auto code = static_cast<const uint8_t*>(jit.code());
+    size_t region = 0;
+    bool header_done = false;
+
+    out << "; /" << pattern << "/, " << jit.code_size() << " bytes\n";
+    for (size_t i = 0; i < lines.size(); i++) {
+        const AsmLine& line = lines[i];
+        while (region + 1 < regions.size() && line.offset >= regions[region + 1].offset) {
+            region++;
+            header_done = false;
+        }
+        if (!header_done) {
+            const CodeRegion& r = regions[region];
+            out << "\n; ";
+            if (r.glue) {
+                out << "(glue)";
+            } else {
+                out << pattern.substr(r.src_begin, r.src_end - r.src_begin) << "    ["
+                    << r.src_begin << "," << r.src_end << ")";
+            }
+            out << "\n";
+            header_done = true;
+        }
+        if (line.text.back() == ':') {
+            out << line.text << "\n";
+            continue;
+        }
+
+        // The instruction's bytes run up to the next instruction
+        size_t end = jit.code_size();
+        for (size_t j = i + 1; j < lines.size(); j++) {
+            if (lines[j].text.back() != ':') {
+                end = lines[j].offset;
+                break;
+            }
+        }
+        std::ostringstream bytes;
+        for (size_t b = line.offset; b < end; b++) {
+            bytes << std::hex << std::setw(2) << std::setfill('0') << (int)code[b] << ' ';
+        }
+        out << "  " << std::hex << std::setw(4) << std::setfill('0') << line.offset << std::dec
+            << std::setfill(' ') << "  " << std::left << std::setw(33) << bytes.str()
+            << std::right << line.text << "\n";
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include "jit.h"
+
+// Profiler and tuning aids for generated code. Each code region becomes one
+// symbol named after the part of `pattern` it was compiled from, so perf
+// attributes cycles to pieces of the regex.
+
+// Append the regions to /tmp/perf-<pid>.map
+void write_perf_map(const JIT& jit, const std::string& pattern);
+
+// Append the regions, with their code, to /tmp/jit-<pid>.dump in perf's
+// jitdump format (use `perf record -k 1` and `perf inject --jit`)
+void write_jitdump(const JIT& jit, const std::string& pattern);
+
+// Write the raw generated code to `path`
+void write_code(const JIT& jit, const std::string& path);
+
+// Print the assembly listing (compile with JitOptions::listing), with each
+// region headed by the pattern substring it implements
+void print_listing(std::ostream& out, const JIT& jit, const std::string& pattern);
@@ -0,0 +1,214 @@
+#include "matcher.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <immintrin.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+// Each lane runs the DFA over one line and the '\n' that ends it (or would
+// end it, for a last line without one). Two states beyond the DFA's keep a
+// lane put once its line is decided: `matched`, entered on any transition
+// that accepts, and `done`, entered on '\n' otherwise. Both loop on every
+// byte, so after its '\n' a lane may read anything, including the lines
+// that follow; only reads past the end of the buffer are replaced by '\n'.
+//
+// A batch that finds a match has done its lanes after the first one for
+// nothing, as find() returns at the first matching line. Where matches are
+// dense batches shrink, halving after each one that matches and doubling
+// after each that does not; under MIN_BATCH lines, lines are run one by one.
+
+static const size_t MIN_BATCH = 8;
+
+LaneDfaMatcher::LaneDfaMatcher(const Glushkov& g) {
+    LazyDfa dfa(g, SIZE_MAX);
+    match_all_ = !g.nullable.empty() || !dfa.accepts(dfa.start()).empty();
+
+    CompleteDfa complete;
+    if (!complete_dfa(dfa, MAX_STATES, complete)) {
+        throw std::runtime_error("pattern needs more than " + std::to_string(MAX_STATES)
+                                 + " DFA states for --engine=lanes");
+    }
+    states_ = complete.next.size();
+    uint8_t matched = (uint8_t)states_, done = (uint8_t)states_ + 1;
+    tables_.matched = matched;
+
+    std::vector<uint8_t>& next = tables_.next;
+    next.resize((states_ + 2) * 256);
+    for (size_t s = 0; s < states_; s++) {
+        for (int c = 0; c < 256; c++) {
+            uint32_t t = complete.next[s][dfa.byte_class((uint8_t)c)];
+            next[s * 256 + c] = t == CompleteDfa::MATCH ? matched : (uint8_t)t;
+        }
+        next[s * 256 + '\n'] = complete.eol_accepts[s] ? matched : done;
+    }
+    std::fill(next.begin() + matched * 256, next.begin() + done * 256, matched);
+    std::fill(next.begin() + done * 256, next.end(), done);
+
+    // Group bytes by their column of transitions, the largest group first
+    std::map<std::array<uint8_t, 16>, std::vector<int>> columns;
+    for (int c = 0; c < 256; c++) {
+        std::array<uint8_t, 16> column = {};
+        for (size_t s = 0; s < states_ + 2; s++) column[s] = next[s * 256 + c];
+        columns[column].push_back(c);
+    }
+    std::vector<std::pair<std::array<uint8_t, 16>, std::vector<int>>> groups(columns.begin(), columns.end());
+    std::stable_sort(groups.begin(), groups.end(), [](const auto& a, const auto& b) {
+        return a.second.size() > b.second.size();
+    });
+    for (size_t i = 0; i < groups.size(); i++) {
+        tables_.shuffles.insert(tables_.shuffles.end(), groups[i].first.begin(), groups[i].first.end());
+        if (i == 0) continue;
+        for (int c : groups[i].second) {
+            std::vector<Range>& ranges = tables_.ranges;
+            if (!ranges.empty() && ranges.back().group == i && ranges.back().last + 1 == c) {
+                ranges.back().last = (uint8_t)c;
+            } else {
+                ranges.push_back({(uint8_t)c, (uint8_t)c, (uint8_t)i});
+            }
+        }
+    }
+    if (tables_.ranges.size() > MAX_RANGES) {
+        throw std::runtime_error("pattern tells apart more than " + std::to_string(MAX_RANGES)
+                                 + " byte ranges for --engine=lanes");
+    }
+
+    avx2_ = __builtin_cpu_supports("avx2");
+}
+
+// Whether the line [bol, eol) matches, one byte at a time
+bool LaneDfaMatcher::match_line(const char* bol, const char* eol) const {
+    const uint8_t* next = tables_.next.data();
+    unsigned s = 0;
+    for (const char* p = bol; p < eol; p++) {
+        s = next[s * 256 + (uint8_t)*p];
+        if (s == tables_.matched) return true;
+    }
+    return next[s * 256 + '\n'] == tables_.matched;
+}
+
+// Bytes [offset, offset + 16) of the line at `bol`, with those at or past
+// `end` replaced by '\n'
+static __m128i lane_bytes(const char* bol, size_t offset, const char* end) {
+    const char* p = bol + offset;
+    if (end - p >= 16) return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    char tail[16];
+    memset(tail, '\n', sizeof tail);
+    if (end > p) memcpy(tail, p, end - p);
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+}
+
+// The lines at `bols`, of lengths `lengths` (without '\n'), that match, as a
+// bitmask by lane. Lanes from `count` to LANES are idle.
+__attribute__((target("avx2")))
+static uint32_t match_batch_avx2(const LaneDfaMatcher::Tables& tables, const char* const* bols,
+                                 const size_t* lengths, size_t count, const char* end) {
+    const size_t groups = tables.shuffles.size() / 16;
+    const size_t ranges = tables.ranges.size();
+    __m256i shuffles[LaneDfaMatcher::MAX_RANGES + 1], firsts[LaneDfaMatcher::MAX_RANGES], lasts[LaneDfaMatcher::MAX_RANGES];
+    for (size_t g = 0; g < groups; g++) {
+        shuffles[g] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(tables.shuffles.data() + 16 * g)));
+    }
+    for (size_t r = 0; r < ranges; r++) {
+        firsts[r] = _mm256_set1_epi8((char)tables.ranges[r].first);
+        lasts[r] = _mm256_set1_epi8((char)tables.ranges[r].last);
+    }
+
+    size_t longest = 0;
+    for (size_t i = 0; i < count; i++) longest = std::max(longest, lengths[i]);
+
+    const __m128i newlines = _mm_set1_epi8('\n');
+    __m256i s = _mm256_setzero_si256();
+    for (size_t offset = 0; offset <= longest; offset += 16) {
+        // Row i holds lanes i and i + 16; four rounds of interleaving turn
+        // rows into steps, each holding byte `offset + k` of every lane
+        __m256i v[16];
+        for (size_t i = 0; i < 16; i++) {
+            size_t j = i + 16;
+            __m128i lo = i < count && offset <= lengths[i] ? lane_bytes(bols[i], offset, end) : newlines;
+            __m128i hi = j < count && offset <= lengths[j] ? lane_bytes(bols[j], offset, end) : newlines;
+            v[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        }
+        for (int round = 0; round < 4; round++) {
+            __m256i t[16];
+            for (size_t i = 0; i < 8; i++) {
+                t[2 * i] = _mm256_unpacklo_epi8(v[i], v[i + 8]);
+                t[2 * i + 1] = _mm256_unpackhi_epi8(v[i], v[i + 8]);
+            }
+            std::copy(t, t + 16, v);
+        }
+
+        size_t steps = std::min<size_t>(16, longest + 1 - offset);
+        for (size_t k = 0; k < steps; k++) {
+            __m256i c = v[k];
+            __m256i next = _mm256_shuffle_epi8(shuffles[0], s);
+            for (size_t r = 0; r < ranges;) {
+                size_t g = tables.ranges[r].group;
+                __m256i in = _mm256_setzero_si256();
+                for (; r < ranges && tables.ranges[r].group == g; r++) {
+                    __m256i inside = tables.ranges[r].first == tables.ranges[r].last
+                        ? _mm256_cmpeq_epi8(c, firsts[r])
+                        : _mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_max_epu8(c, firsts[r]), lasts[r]), c);
+                    in = _mm256_or_si256(in, inside);
+                }
+                next = _mm256_blendv_epi8(next, _mm256_shuffle_epi8(shuffles[g], s), in);
+            }
+            s = next;
+        }
+    }
+    // Idle lanes read an empty line, which may match
+    uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(s, _mm256_set1_epi8((char)tables.matched)));
+    return count < 32 ? mask & ((1u << count) - 1) : mask;
+}
+
+const char* LaneDfaMatcher::find(const char* begin, const char* end) {
+    if (match_all_) return begin;
+
+    const char* p = begin;
+    while (p < end) {
+        // Gather up to batch_ lines, stopping short of a long one
+        const char* bols[LANES];
+        size_t lengths[LANES];
+        size_t count = 0;
+        const char* eol = nullptr;
+        bool long_line = false;
+        while (p < end && count < batch_) {
+            eol = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!eol) eol = end;
+            if ((size_t)(eol - p) > MAX_LINE) {
+                long_line = true;
+                break;
+            }
+            bols[count] = p;
+            lengths[count++] = eol - p;
+            p = eol + 1;
+        }
+
+        uint32_t mask = 0;
+        if (count >= MIN_BATCH && avx2_) {
+            mask = match_batch_avx2(tables_, bols, lengths, count, end);
+        } else {
+            for (size_t i = 0; i < count && !mask; i++) {
+                if (match_line(bols[i], bols[i] + lengths[i])) mask = 1u << i;
+            }
+        }
+        if (mask) {
+            batch_ = std::max<size_t>(1, batch_ / 2);
+            return bols[__builtin_ctz(mask)];
+        }
+        batch_ = std::min(LANES, batch_ * 2);
+
+        if (long_line) {
+            if (match_line(p, eol)) return p;
+            p = eol + 1;
+        }
+    }
+    return end;
+}
+
+void LaneDfaMatcher::report(Stats& stats) const {
+    stats.automaton_states = states_;
+    stats.automaton_size = tables_.shuffles.size() + tables_.next.size();
+}
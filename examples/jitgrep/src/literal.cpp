@@ -0,0 +1,67 @@
+#include "matcher.h"
+#include <cstring>
+#include <immintrin.h>
+#include <stdexcept>
+
+// Candidate positions are those where both the first and the last byte of
+// the needle line up; each SIMD step tests 16 or 32 of them at once.
+
+static const char* find_sse2(const char* s, const char* end, const char* needle, size_t n) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    const char* p = s;
+    for (; (size_t)(end - p) >= n + 15; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            int i = __builtin_ctz(mask);
+            if (memcmp(p + i + 1, needle + 1, n - 2) == 0) return p + i;
+            mask &= mask - 1;
+        }
+    }
+    for (; (size_t)(end - p) >= n; p++) {
+        if (p[0] == needle[0] && memcmp(p, needle, n) == 0) return p;
+    }
+    return nullptr;
+}
+
+__attribute__((target("avx2")))
+static const char* find_avx2(const char* s, const char* end, const char* needle, size_t n) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+    const char* p = s;
+    for (; (size_t)(end - p) >= n + 31; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + n - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask) {
+            int i = __builtin_ctz(mask);
+            if (memcmp(p + i + 1, needle + 1, n - 2) == 0) return p + i;
+            mask &= mask - 1;
+        }
+    }
+    return find_sse2(p, end, needle, n);
+}
+
+LiteralMatcher::LiteralMatcher(const std::string& needle)
+    : needle_(needle), avx2_(__builtin_cpu_supports("avx2")) {
+    if (needle_.find('\n') != std::string::npos) {
+        throw std::runtime_error("Fixed string contains a newline");
+    }
+}
+
+const char* LiteralMatcher::find(const char* begin, const char* end) {
+    size_t n = needle_.size();
+    if (n == 0) return begin;
+    if (n == 1) {
+        const void* hit = memchr(begin, needle_[0], end - begin);
+        return hit ? static_cast<const char*>(hit) : end;
+    }
+    if ((size_t)(end - begin) < n) return end;
+
+    // The needle has no '\n', so any hit lies within a single line
+    const char* hit = avx2_ ? find_avx2(begin, end, needle_.data(), n)
+                            : find_sse2(begin, end, needle_.data(), n);
+    return hit ? hit : end;
+}
@@ -1,49 +1,703 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <getopt.h>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "regex.h"
+#include "code_arena.h"
+#include "glushkov.h"
+#include "follow.h"
 #include "jit.h"
+#include "grep.h"
+#include "jit_debug.h"
+#include "matcher.h"
+#include "server.h"
+#include "stats.h"
+#include "stream.h"
+#include "substitute.h"
+#include "trigram_index.h"
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <pattern>" << std::endl;
-        return 1;
+using Clock = std::chrono::steady_clock;
+
+// Searches a --serve server keeps compiled
+static const size_t CACHED_SEARCHES = 256;
+
+// How a single regex is run
+enum Engine {
+    ENGINE_AUTO,      // the NFA if the pattern fits, else backtracking
+    ENGINE_BACKTRACK, // the backtracking JIT
+    ENGINE_NFA,       // the bit-parallel NFA (at most 64 positions)
+    ENGINE_DFA,       // the lazy DFA also used for regex sets
+    ENGINE_AOT,       // the whole DFA compiled to native code
+    ENGINE_LANES      // a small DFA run on many lines at once in SIMD lanes
+};
+
+struct Options {
+    std::vector<std::string> patterns;
+    std::vector<const char*> pattern_files;
+    bool listed = false; // patterns came from -e or -f
+    std::vector<const char*> files;
+    const char* index_dir = nullptr; // search the files indexed there
+    bool follow = false;
+    bool stream = false;
+    const char* connect = nullptr; // run on the server at this socket
+    bool substitute = false;
+    std::string replacement;
+    size_t field = 0;  // match only this field (-k, from 1), 0 for whole lines
+    char delim = '\t'; // between fields (-d)
+    bool delim_given = false;
+    bool fixed = false;
+    GrepOptions output;
+    Engine engine = ENGINE_AUTO;
+    uint64_t pgo_lines = 0;
+    bool stats = false;
+    bool stats_json = false;
+    bool stats_frames = false;
+    bool asm_listing = false;
+    bool perf_map = false;
+    bool jitdump = false;
+    std::string dump_code;
+};
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] <pattern> [file...]\n"
+              << "       " << prog << " [options] -e PATTERN... | -f FILE... [file...]\n"
+              << "       " << prog << " -s [options] <pattern> <replacement> [file...]\n"
+              << "       " << prog << " index DIR\n"
+              << "       " << prog << " --serve SOCKET\n"
+              << "  index DIR       index the trigrams of every file under DIR into\n"
+              << "                  DIR/" << INDEX_FILE_NAME << ", for --index\n"
+              << "  --serve SOCKET  serve searches from --connect on the Unix socket\n"
+              << "                  SOCKET, keeping what they compile for the next\n"
+              << "                  searches of the same patterns\n"
+              << "  -e PATTERN      match PATTERN; repeat to match any of several\n"
+              << "  -f FILE         read patterns from FILE, one per line\n"
+              << "  -F              treat patterns as fixed strings, not regexes\n"
+              << "  -A NUM          print NUM lines of context after each match\n"
+              << "  -B NUM          print NUM lines of context before each match\n"
+              << "  -C NUM          print NUM lines of context before and after\n"
+              << "  -n              prefix each line with its line number\n"
+              << "  -k N            match only field N of each line, counting from 1,\n"
+              << "                  with ^ and $ at the ends of the field; lines with\n"
+              << "                  fewer fields do not match, and lines print whole\n"
+              << "  -d DELIM        with -k, fields are separated by the byte DELIM\n"
+              << "                  (default tab); there is no quoting, as with cut\n"
+              << "  -s              substitute: the operand after the pattern is a\n"
+              << "                  replacement, and every line is printed with each\n"
+              << "                  match replaced, like sed -E 's/PATTERN/REPLACEMENT/g';\n"
+              << "                  \\1..\\9 in it stand for groups, & or \\0 for the match\n"
+              << "  --ids           prefix each matching line with the numbers of all\n"
+              << "                  patterns that match it, e.g. 2,7:line; -e patterns are\n"
+              << "                  numbered first, then the lines of -f files\n"
+              << "  --index=DIR     search the files indexed under DIR instead of file\n"
+              << "                  operands, skipping those the index rules out; files\n"
+              << "                  changed since indexing are always searched\n"
+              << "  --follow        keep watching the files and print matching lines as\n"
+              << "                  they are appended, like tail -F; follows renamed\n"
+              << "                  (rotated) and truncated files by name\n"
+              << "  --stream        scan in fixed-size chunks however long the lines are,\n"
+              << "                  and print START,END byte offsets for each matching\n"
+              << "                  line: where it starts and where its first match ends\n"
+              << "  --connect=SOCKET  run the search on the --serve server at SOCKET,\n"
+              << "                  which skips compiling patterns it has seen; files\n"
+              << "                  are opened here and passed to it. Takes no -f,\n"
+              << "                  --index, --follow, --asm, --perf-map, --jitdump\n"
+              << "                  or --dump-code\n"
+              << "  --engine=NAME   run a single regex with NAME: backtrack (JIT with\n"
+              << "                  backtracking), nfa (bit-parallel NFA in generated\n"
+              << "                  code, patterns of up to 64 positions), dfa (lazy\n"
+              << "                  DFA), aot (whole DFA compiled to code, patterns of up\n"
+              << "                  to 1024 DFA states), lanes (small DFA run on 32 lines\n"
+              << "                  at once with AVX2, patterns of up to 14 DFA states),\n"
+              << "                  or auto (default: nfa if it fits, else backtrack)\n"
+              << "  --pgo[=LINES]   profile which alternatives match over LINES lines\n"
+              << "                  (default 10000), recompile trying them in that\n"
+              << "                  order, and re-profile every 100 x LINES lines\n"
+              << "  --stats[=LIST]  report timings and counters on stderr; LIST is\n"
+              << "                  comma-separated: text (default), json, and frames\n"
+              << "                  to count backtrack frames with instrumented code\n"
+              << "  --asm           print the generated code, annotated with the pattern\n"
+              << "                  substring each part implements, and exit\n"
+              << "  --perf-map      write symbols for the generated code to /tmp/perf-PID.map\n"
+              << "  --jitdump       write the generated code to /tmp/jit-PID.dump for\n"
+              << "                  perf record -k 1 / perf inject --jit\n"
+              << "  --dump-code=FILE  write the raw generated code to FILE\n";
+}
+
+static bool parse_stats(const char* list, Options& opts) {
+    opts.stats = true;
+    if (!list) return true;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item == "json") {
+            opts.stats_json = true;
+        } else if (item == "text") {
+            opts.stats_json = false;
+        } else if (item == "frames") {
+            opts.stats_frames = true;
+        } else {
+            std::cerr << "Error: unknown --stats item '" << item << "'" << std::endl;
+            return false;
+        }
     }
+    return true;
+}
 
-    std::string pattern = argv[1];
+static bool parse_count(const char* arg, size_t& count) {
+    char* end;
+    errno = 0;
+    unsigned long long n = strtoull(arg, &end, 10);
+    if (errno || end == arg || *end || arg[0] == '-') {
+        std::cerr << "Error: invalid number '" << arg << "'" << std::endl;
+        return false;
+    }
+    count = n;
+    return true;
+}
+
+static bool parse_context(const char* arg, size_t& count, Options& opts) {
+    opts.output.context = true;
+    return parse_count(arg, count);
+}
+
+static bool parse_options(int argc, char** argv, Options& opts) {
+    enum { OPT_IDS = 256, OPT_INDEX, OPT_FOLLOW, OPT_STREAM, OPT_CONNECT, OPT_ENGINE, OPT_PGO, OPT_STATS, OPT_ASM, OPT_PERF_MAP, OPT_JITDUMP, OPT_DUMP_CODE };
+    static const option long_options[] = {
+        {"ids", no_argument, nullptr, OPT_IDS},
+        {"index", required_argument, nullptr, OPT_INDEX},
+        {"follow", no_argument, nullptr, OPT_FOLLOW},
+        {"stream", no_argument, nullptr, OPT_STREAM},
+        {"connect", required_argument, nullptr, OPT_CONNECT},
+        {"engine", required_argument, nullptr, OPT_ENGINE},
+        {"pgo", optional_argument, nullptr, OPT_PGO},
+        {"stats", optional_argument, nullptr, OPT_STATS},
+        {"asm", no_argument, nullptr, OPT_ASM},
+        {"perf-map", no_argument, nullptr, OPT_PERF_MAP},
+        {"jitdump", no_argument, nullptr, OPT_JITDUMP},
+        {"dump-code", required_argument, nullptr, OPT_DUMP_CODE},
+        {nullptr, 0, nullptr, 0},
+    };
+    // -C only sets the sides -A and -B leave, in whatever order they come
+    size_t both = 0;
+    bool after_given = false, before_given = false;
+    int c;
+    while ((c = getopt_long(argc, argv, "A:B:C:d:e:Ff:k:ns", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'A':
+                if (!parse_context(optarg, opts.output.after, opts)) return false;
+                after_given = true;
+                break;
+            case 'B':
+                if (!parse_context(optarg, opts.output.before, opts)) return false;
+                before_given = true;
+                break;
+            case 'C':
+                if (!parse_context(optarg, both, opts)) return false;
+                break;
+            case 'F':
+                opts.fixed = true;
+                break;
+            case 'd':
+                if (strlen(optarg) != 1 || optarg[0] == '\n') {
+                    std::cerr << "Error: -d takes a single byte other than newline" << std::endl;
+                    return false;
+                }
+                opts.delim = optarg[0];
+                opts.delim_given = true;
+                break;
+            case 'k':
+                if (!parse_count(optarg, opts.field)) return false;
+                if (opts.field == 0) {
+                    std::cerr << "Error: -k counts fields from 1" << std::endl;
+                    return false;
+                }
+                break;
+            case 'n':
+                opts.output.line_numbers = true;
+                break;
+            case 's':
+                opts.substitute = true;
+                break;
+            case 'e':
+                opts.patterns.push_back(optarg);
+                opts.listed = true;
+                break;
+            case 'f':
+                opts.pattern_files.push_back(optarg);
+                opts.listed = true;
+                break;
+            case OPT_IDS:
+                opts.output.ids = true;
+                break;
+            case OPT_INDEX:
+                opts.index_dir = optarg;
+                break;
+            case OPT_FOLLOW:
+                opts.follow = true;
+                break;
+            case OPT_STREAM:
+                opts.stream = true;
+                break;
+            case OPT_CONNECT:
+                opts.connect = optarg;
+                break;
+            case OPT_ENGINE:
+                if (strcmp(optarg, "auto") == 0) {
+                    opts.engine = ENGINE_AUTO;
+                } else if (strcmp(optarg, "backtrack") == 0) {
+                    opts.engine = ENGINE_BACKTRACK;
+                } else if (strcmp(optarg, "nfa") == 0) {
+                    opts.engine = ENGINE_NFA;
+                } else if (strcmp(optarg, "dfa") == 0) {
+                    opts.engine = ENGINE_DFA;
+                } else if (strcmp(optarg, "aot") == 0) {
+                    opts.engine = ENGINE_AOT;
+                } else if (strcmp(optarg, "lanes") == 0) {
+                    opts.engine = ENGINE_LANES;
+                } else {
+                    std::cerr << "Error: unknown engine '" << optarg << "'" << std::endl;
+                    return false;
+                }
+                break;
+            case OPT_PGO: {
+                size_t lines = 10000;
+                if (optarg && !parse_count(optarg, lines)) return false;
+                if (lines == 0) {
+                    std::cerr << "Error: --pgo needs at least one line" << std::endl;
+                    return false;
+                }
+                opts.pgo_lines = lines;
+                break;
+            }
+            case OPT_STATS:
+                if (!parse_stats(optarg, opts)) return false;
+                break;
+            case OPT_ASM:
+                opts.asm_listing = true;
+                break;
+            case OPT_PERF_MAP:
+                opts.perf_map = true;
+                break;
+            case OPT_JITDUMP:
+                opts.jitdump = true;
+                break;
+            case OPT_DUMP_CODE:
+                opts.dump_code = optarg;
+                break;
+            default:
+                return false;
+        }
+    }
+    if (!after_given) opts.output.after = both;
+    if (!before_given) opts.output.before = both;
+    if (!opts.listed) {
+        if (optind >= argc) return false;
+        opts.patterns.push_back(argv[optind++]);
+    }
+    if (opts.delim_given && !opts.field) {
+        std::cerr << "Error: -d needs -k" << std::endl;
+        return false;
+    }
+    if (opts.field && (opts.stream || opts.substitute)) {
+        std::cerr << "Error: -k takes no --stream or -s" << std::endl;
+        return false;
+    }
+    if (opts.substitute) {
+        if (opts.listed || opts.output.context || opts.output.line_numbers || opts.output.ids || opts.index_dir
+            || opts.follow || opts.stream) {
+            std::cerr << "Error: -s takes one PATTERN operand and no -e, -f, -A, -B, -C, -n, --ids, --index,"
+                      << " --follow or --stream" << std::endl;
+            return false;
+        }
+        if (optind >= argc) return false;
+        opts.replacement = argv[optind++];
+    }
+    opts.files.assign(argv + optind, argv + argc);
+    if (opts.index_dir && !opts.files.empty()) {
+        std::cerr << "Error: --index searches the indexed files and takes no file operands" << std::endl;
+        return false;
+    }
+    if (opts.stream && (opts.output.context || opts.output.line_numbers || opts.output.ids || opts.follow
+                        || (opts.engine != ENGINE_AUTO && opts.engine != ENGINE_DFA))) {
+        std::cerr << "Error: --stream prints offsets from the DFA and takes no -A, -B, -C, -n, --ids,"
+                  << " --follow or other engine" << std::endl;
+        return false;
+    }
+    if (opts.connect && (!opts.pattern_files.empty() || opts.index_dir || opts.follow || opts.asm_listing
+                         || opts.perf_map || opts.jitdump || !opts.dump_code.empty())) {
+        std::cerr << "Error: --connect takes no -f, --index, --follow, --asm, --perf-map, --jitdump"
+                  << " or --dump-code" << std::endl;
+        return false;
+    }
+    if (opts.follow) {
+        if (opts.files.empty() && !opts.index_dir) {
+            std::cerr << "Error: --follow needs files to watch" << std::endl;
+            return false;
+        }
+        if (std::find_if(opts.files.begin(), opts.files.end(),
+                         [](const char* f) { return strcmp(f, "-") == 0; }) != opts.files.end()) {
+            std::cerr << "Error: --follow cannot watch standard input" << std::endl;
+            return false;
+        }
+        if (opts.stats) {
+            std::cerr << "Error: --follow runs until interrupted and has no --stats to report" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Append the lines of `path` to `patterns`
+static void read_patterns(const char* path, std::vector<std::string>& patterns) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error(std::string(path) + ": " + strerror(errno));
+    std::string line;
+    while (std::getline(in, line)) patterns.push_back(line);
+    if (in.bad()) throw std::runtime_error(std::string(path) + ": " + strerror(errno));
+}
+
+// True if `pattern` has no regex syntax and so matches only itself
+static bool is_literal(const std::string& pattern) {
+    return pattern.find_first_of(".*|()^$\\") == std::string::npos;
+}
+
+static bool is_directory(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Opens the input `name` of a search, "-" being standard input. Returns -1
+// with errno set on failure.
+using OpenInput = std::function<int(const char* name)>;
+
+// The key under which a server keeps what a search with `opts` compiles:
+// its patterns and every option that picks or shapes an engine
+static std::string cache_key(const Options& opts) {
+    std::string key = std::to_string(opts.engine) + (opts.fixed ? " F" : "") + (opts.listed ? " e" : "")
+        + (opts.output.ids ? " ids" : "") + (opts.stream ? " stream" : "") + (opts.stats_frames ? " frames" : "")
+        + " pgo=" + std::to_string(opts.pgo_lines) + " k=" + std::to_string(opts.field) + opts.delim;
+    if (opts.substitute) {
+        key += " s=";
+        key += opts.replacement;
+    }
+    for (const std::string& p : opts.patterns) {
+        key += '\0';
+        key += p;
+    }
+    return key;
+}
+
+// Run the search `opts` describes, printing to `out` and `err`. With a
+// cache, engines compiled for earlier searches are reused, and those
+// compiled now are kept for later ones.
+static int search(Options& opts, std::ostream& out, std::ostream& err, const OpenInput& open_input,
+                  CompiledCache* cache) {
+    int status = 0;
+    Stats stats;
 
     try {
-        auto root = parse_regex(pattern);
-        if (!root) {
-            std::cerr << "Empty regex parsed." << std::endl;
+        for (const char* path : opts.pattern_files) read_patterns(path, opts.patterns);
+
+        // Sets of plain strings skip the parser and the JIT
+        bool literal = opts.fixed
+            || (opts.listed && std::all_of(opts.patterns.begin(), opts.patterns.end(), is_literal));
+
+        // Code dumps, profiling and frame counts need the backtracking JIT,
+        // which only runs a single regex; sets share one DFA
+        bool backtrack_only = opts.asm_listing || opts.perf_map || opts.jitdump
+            || !opts.dump_code.empty() || opts.pgo_lines || opts.stats_frames;
+        bool single_regex = !opts.output.ids && !literal && !opts.stream && opts.patterns.size() == 1;
+        if (backtrack_only && (!single_regex || (opts.engine != ENGINE_AUTO && opts.engine != ENGINE_BACKTRACK))) {
+            err << "Error: --asm, --perf-map, --jitdump, --dump-code, --pgo and --stats=frames"
+                      << " need a single regex on the backtracking engine" << std::endl;
             return 1;
         }
 
-        JIT jit;
-        jit.compile(root);
+        // A server looks for engines compiled by earlier searches first
+        std::string key;
+        std::unique_ptr<Compiled> compiled;
+        if (cache) {
+            key = cache_key(opts);
+            compiled = cache->take(key);
+            if (compiled && compiled->matcher) compiled->matcher->reset_counters();
+        }
+        uint64_t arena_syscalls = CodeArena::instance().syscalls();
+        if (!compiled) {
+            // Code compiled for this search shares chunks of the arena, which
+            // are made executable together when the batch ends
+            std::optional<CodeArena::Batch> batch;
+            batch.emplace();
+            compiled = std::make_unique<Compiled>();
+            std::unique_ptr<Matcher>& matcher = compiled->matcher;
+            std::unique_ptr<StreamMatcher>& stream = compiled->stream;
+            if (opts.stream) {
+                auto parse_start = Clock::now();
+                std::vector<std::shared_ptr<Node>> roots;
+                for (const std::string& p : opts.patterns) {
+                    roots.push_back(literal ? literal_regex(p) : parse_regex(p));
+                }
+                stats.parse_ms = ms_since(parse_start);
+
+                auto build_start = Clock::now();
+                stream = std::make_unique<StreamMatcher>(roots);
+                stats.codegen_ms = ms_since(build_start);
+            } else if (opts.output.ids || (!literal && opts.patterns.size() > 1)) {
+                auto parse_start = Clock::now();
+                std::vector<std::shared_ptr<Node>> roots;
+                for (const std::string& p : opts.patterns) {
+                    roots.push_back(opts.fixed ? literal_regex(p) : parse_regex(p));
+                }
+                stats.parse_ms = ms_since(parse_start);
+
+                auto build_start = Clock::now();
+                matcher = std::make_unique<RegexSetMatcher>(roots);
+                stats.codegen_ms = ms_since(build_start);
+            } else if (literal) {
+                auto build_start = Clock::now();
+                if (opts.patterns.size() == 1) {
+                    matcher = std::make_unique<LiteralMatcher>(opts.patterns[0]);
+                } else {
+                    matcher = std::make_unique<AhoCorasickMatcher>(opts.patterns);
+                }
+                stats.codegen_ms = ms_since(build_start);
+            } else {
+                const std::string& pattern = opts.patterns[0];
+
+                auto parse_start = Clock::now();
+                auto root = parse_regex(pattern);
+                stats.parse_ms = ms_since(parse_start);
+                if (!root) {
+                    err << "Empty regex parsed." << std::endl;
+                    return 1;
+                }
+
+                Engine engine = opts.engine;
+                std::unique_ptr<Glushkov> glushkov;
+                if (engine == ENGINE_AUTO && needs_backtracking(root.get())) engine = ENGINE_BACKTRACK;
+                if (engine == ENGINE_AUTO || engine == ENGINE_NFA) {
+                    glushkov = std::make_unique<Glushkov>(std::vector<std::shared_ptr<Node>>{root});
+                    bool fits = glushkov->symbol.size() <= BitNfaMatcher::MAX_POSITIONS;
+                    if (engine == ENGINE_NFA && !fits) {
+                        err << "Error: pattern has more than " << BitNfaMatcher::MAX_POSITIONS
+                                  << " positions for --engine=nfa" << std::endl;
+                        return 1;
+                    }
+                    engine = fits && !backtrack_only ? ENGINE_NFA : ENGINE_BACKTRACK;
+                }
+
+                if (engine == ENGINE_NFA) {
+                    auto build_start = Clock::now();
+                    matcher = std::make_unique<BitNfaMatcher>(*glushkov);
+                    stats.codegen_ms = ms_since(build_start);
+                } else if (engine == ENGINE_AOT) {
+                    auto build_start = Clock::now();
+                    matcher = std::make_unique<AotDfaMatcher>(Glushkov(std::vector<std::shared_ptr<Node>>{root}));
+                    stats.codegen_ms = ms_since(build_start);
+                } else if (engine == ENGINE_LANES) {
+                    auto build_start = Clock::now();
+                    matcher = std::make_unique<LaneDfaMatcher>(Glushkov(std::vector<std::shared_ptr<Node>>{root}));
+                    stats.codegen_ms = ms_since(build_start);
+                } else if (engine == ENGINE_DFA) {
+                    auto build_start = Clock::now();
+                    matcher = std::make_unique<RegexSetMatcher>(std::vector<std::shared_ptr<Node>>{root});
+                    stats.codegen_ms = ms_since(build_start);
+                } else {
+                    JitOptions jit_options;
+                    jit_options.count_frames = opts.stats_frames;
+                    jit_options.listing = opts.asm_listing;
+
+                    auto codegen_start = Clock::now();
+                    auto jit_matcher = std::make_unique<JitMatcher>(root, jit_options, opts.pgo_lines);
+                    stats.codegen_ms = ms_since(codegen_start);
 
-        std::string line;
-        while (std::getline(std::cin, line)) {
-            bool matched = false;
-            const char* start = line.c_str();
-            
-            // Try matching at every position
-            for (size_t i = 0; i <= line.length(); ++i) {
-                if (jit.execute(start + i, start)) {
-                    matched = true;
-                    break;
+                    const JIT& jit = jit_matcher->jit();
+                    if (opts.perf_map) write_perf_map(jit, pattern);
+                    if (opts.jitdump) write_jitdump(jit, pattern);
+                    if (!opts.dump_code.empty()) write_code(jit, opts.dump_code);
+                    if (opts.asm_listing) {
+                        print_listing(out, jit, pattern);
+                        return 0;
+                    }
+                    matcher = std::move(jit_matcher);
                 }
             }
+            if (opts.substitute) {
+                auto build_start = Clock::now();
+                const std::string& p = opts.patterns[0];
+                auto root = opts.fixed ? literal_regex(p) : parse_regex(p);
+                compiled->substituter = std::make_unique<Substituter>(*matcher, root, opts.replacement);
+                stats.codegen_ms += ms_since(build_start);
+            }
+            // FieldMatcher runs the engine, so its code must be executable
+            batch.reset();
+            if (opts.field) matcher = std::make_unique<FieldMatcher>(std::move(matcher), opts.delim, opts.field - 1);
+        }
+        stats.arena_syscalls = CodeArena::instance().syscalls() - arena_syscalls;
+        stats.arena_chunks = CodeArena::instance().chunk_count();
+        Matcher* matcher = compiled->matcher.get();
+        StreamMatcher* stream = compiled->stream.get();
+        Substituter* substituter = compiled->substituter.get();
+
+        // The index narrows the files to those holding every trigram that a
+        // match needs
+        std::vector<std::string> indexed;
+        if (opts.index_dir) {
+            auto index_start = Clock::now();
+            std::vector<std::shared_ptr<Node>> roots;
+            for (const std::string& p : opts.patterns) {
+                roots.push_back(literal ? literal_regex(p) : parse_regex(p));
+            }
+            TrigramIndex index(opts.index_dir);
+            indexed = index.candidates(trigram_query(roots));
+            for (const std::string& path : indexed) opts.files.push_back(path.c_str());
+            stats.indexed = true;
+            stats.files_indexed = index.file_count();
+            stats.files_searched = indexed.size();
+            stats.index_ms = ms_since(index_start);
+        }
+
+        opts.output.count_lines = opts.stats;
+        if (opts.follow) {
+            Follower follower(*matcher, opts.output, stats, out);
+            for (const char* name : opts.files) {
+                follower.add(name, opts.files.size() > 1 || opts.index_dir ? name : nullptr);
+            }
+            follower.run();
+        }
+
+        std::unique_ptr<Grep> grep;
+        if (!substituter && matcher) grep = std::make_unique<Grep>(*matcher, opts.output, stats, out);
+        auto scan = [&](int fd, const char* label) {
+            if (stream) {
+                stream_offsets(*stream, fd, label, stats, out);
+            } else if (substituter) {
+                substituter->run(fd, stats, out);
+            } else {
+                grep->run(fd, label);
+            }
+        };
+
+        auto scan_start = Clock::now();
+        if (opts.files.empty() && !opts.index_dir) {
+            int fd = open_input("-");
+            if (fd < 0) throw std::runtime_error(std::string("standard input: ") + strerror(errno));
+            try {
+                scan(fd, nullptr);
+            } catch (...) {
+                if (fd != STDIN_FILENO) close(fd);
+                throw;
+            }
+            if (fd != STDIN_FILENO) close(fd);
+        }
+        for (const char* name : opts.files) {
+            const char* label = opts.files.size() > 1 || opts.index_dir ? name : nullptr;
+            int fd = open_input(name);
+            if (fd < 0) {
+                err << "Error: " << name << ": " << strerror(errno) << std::endl;
+                status = 1;
+                continue;
+            }
+            try {
+                scan(fd, label);
+            } catch (const std::exception& e) {
+                err << "Error: " << name << ": " << e.what() << std::endl;
+                status = 1;
+            }
+            if (fd != STDIN_FILENO) close(fd);
+        }
+        stats.scan_ms = ms_since(scan_start);
 
-            if (matched) {
-                std::cout << line << std::endl;
+        if (opts.stats) {
+            stats.frames_counted = opts.stats_frames;
+            if (stream) {
+                stream->report(stats);
+            } else {
+                matcher->report(stats);
+            }
+            if (opts.stats_json) {
+                stats.print_json(err);
+            } else {
+                stats.print_text(err);
             }
         }
+        if (cache) cache->put(key, std::move(compiled));
 
     } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        err << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return status;
+}
+
+int main(int argc, char** argv) {
+    // Searching for "index" in a directory would fail anyway, so this cannot
+    // shadow a search
+    if (argc == 3 && strcmp(argv[1], "index") == 0 && is_directory(argv[2])) {
+        try {
+            return build_trigram_index(argv[2]) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--serve") == 0) {
+        CompiledCache cache(CACHED_SEARCHES);
+        std::mutex getopt_mutex;
+        try {
+            serve(argv[2], [&](Request& request) {
+                std::vector<char*> args{argv[0]};
+                for (std::string& a : request.args) args.push_back(&a[0]);
+                Options opts;
+                {
+                    // getopt keeps its state in globals; optind = 0 resets it
+                    std::lock_guard<std::mutex> lock(getopt_mutex);
+                    optind = 0;
+                    if (!parse_options(args.size(), args.data(), opts) || !opts.connect) {
+                        request.err << "Error: invalid search request" << std::endl;
+                        return 1;
+                    }
+                }
+                return search(opts, request.out, request.err,
+                              [&](const char*) { return request.next_input(); }, &cache);
+            });
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+        return 1;
+    }
+
+    Options opts;
+    if (!parse_options(argc, argv, opts)) {
+        usage(argv[0]);
         return 1;
     }
 
-    return 0;
+    if (opts.connect) {
+        try {
+            return run_client(opts.connect, argc, argv, opts.files);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    auto open_file = [](const char* name) { return strcmp(name, "-") == 0 ? STDIN_FILENO : open(name, O_RDONLY); };
+    return search(opts, std::cout, std::cerr, open_file, nullptr);
 }
@@ -0,0 +1,77 @@
+#include "matcher.h"
+#include <cstring>
+
+// Optimized code runs this many times longer than the profiling phase
+static const uint64_t PGO_RUN_RATIO = 100;
+
+JitMatcher::JitMatcher(std::shared_ptr<Node> root, const JitOptions& options, uint64_t pgo_lines)
+    : root_(root), options_(options), pgo_lines_(pgo_lines) {
+    compile(pgo_lines_ > 0);
+
+    // Nothing to reorder without alternatives
+    if (profiling_ && jit_->branch_hits().empty()) {
+        pgo_lines_ = 0;
+        compile(false);
+        recompiles_ = 0;
+    }
+}
+
+void JitMatcher::compile(bool profile) {
+    JitOptions options = options_;
+    options.profile_branches = profile;
+    options.branch_order = profile_.empty() ? nullptr : &profile_;
+
+    if (jit_) {
+        frames_retired_ += jit_->frames_pushed();
+        recompiles_++;
+    }
+    jit_ = std::make_unique<JIT>();
+    jit_->compile(root_, options);
+    profiling_ = profile;
+    phase_left_ = profile ? pgo_lines_ : pgo_lines_ * PGO_RUN_RATIO;
+}
+
+// Switch between profiling and optimized code. Profiling code keeps the
+// order of the previous profile, so the counts only affect speed.
+void JitMatcher::next_phase() {
+    if (profiling_) profile_ = jit_->branch_hits();
+    compile(!profiling_);
+}
+
+const char* JitMatcher::find(const char* begin, const char* end) {
+    const char* p = begin;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        if (pgo_lines_ && --phase_left_ == 0) next_phase();
+
+        bool matched = false;
+
+        // Try matching at every position
+        for (const char* s = p; s <= eol; ++s) {
+            entries_++;
+            if (jit_->execute(s, p, eol)) {
+                matched = true;
+                break;
+            }
+        }
+
+        if (matched) return p;
+        p = eol + 1;
+    }
+    return end;
+}
+
+void JitMatcher::report(Stats& stats) const {
+    stats.code_size = jit_->code_size();
+    stats.jit_entries = entries_;
+    stats.frames_pushed = frames_retired_ + jit_->frames_pushed();
+    stats.recompiles = recompiles_;
+}
+
+void JitMatcher::reset_counters() {
+    entries_ = 0;
+    frames_retired_ = 0;
+    recompiles_ = 0;
+    jit_->reset_frames_pushed();
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "dfa.h"
+#include "glushkov.h"
+#include "jit.h"
+#include "regex.h"
+#include "stats.h"
+
+// A search engine over buffers of whole lines
+class Matcher {
+public:
+    virtual ~Matcher() = default;
+
+    // Search [begin, end), which holds whole '\n'-separated lines (the last
+    // one possibly unterminated), for the first line with a match. Returns
+    // a pointer into that line (at most its '\n'), or `end` if none match.
+    virtual const char* find(const char* begin, const char* end) = 0;
+
+    // Add engine-specific counters to `stats`
+    virtual void report(Stats&) const {}
+
+    // Zero the counters report() adds, so that an engine kept for another
+    // search reports that search alone
+    virtual void reset_counters() {}
+
+    // Store in `ids` the 0-based indices of all patterns matching the line
+    // [bol, eol). Only engines for pattern sets can tell them apart.
+    virtual void pattern_ids(const char*, const char*, std::vector<uint32_t>& ids) { ids.clear(); }
+};
+
+// The backtracking JIT, entered at every offset of every line.
+// With profile-guided recompilation (pgo_lines > 0) the code alternates
+// between a profiling phase of pgo_lines lines, whose code counts how often
+// each alternative matches, and a much longer phase running code that tries
+// alternatives in the order observed, so it follows changes in the input.
+class JitMatcher : public Matcher {
+public:
+    JitMatcher(std::shared_ptr<Node> root, const JitOptions& options, uint64_t pgo_lines = 0);
+
+    const char* find(const char* begin, const char* end) override;
+    void report(Stats& stats) const override;
+    void reset_counters() override;
+
+    const JIT& jit() const { return *jit_; }
+
+private:
+    void compile(bool profile);
+    void next_phase();
+
+    std::shared_ptr<Node> root_;
+    JitOptions options_;
+    std::unique_ptr<JIT> jit_;
+    uint64_t entries_ = 0;
+    uint64_t frames_retired_ = 0; // pushed by replaced code
+
+    uint64_t pgo_lines_;
+    uint64_t phase_left_ = 0; // lines until the next recompile
+    bool profiling_ = false;
+    BranchProfile profile_;
+    uint64_t recompiles_ = 0;
+};
+
+// A single regex of at most 64 positions, run as a bit-parallel Glushkov
+// NFA in generated code: the set of live positions is one register, and
+// each byte costs a table lookup and a few shifts, ands and ors, whatever
+// the pattern. No backtracking, no DFA states.
+class BitNfaMatcher : public Matcher {
+public:
+    static const size_t MAX_POSITIONS = 64;
+
+    // `g` must hold one pattern of at most MAX_POSITIONS positions
+    explicit BitNfaMatcher(const Glushkov& g);
+    ~BitNfaMatcher();
+
+    BitNfaMatcher(const BitNfaMatcher&) = delete;
+    BitNfaMatcher& operator=(const BitNfaMatcher&) = delete;
+
+    const char* find(const char* begin, const char* end) override;
+    void report(Stats& stats) const override;
+
+private:
+    std::vector<uint64_t> tables_;
+    size_t positions_ = 0;
+    void* code_ = nullptr;
+    size_t code_size_ = 0;
+    bool match_all_ = false;
+};
+
+// A single regex whose DFA is small enough to build whole up front, compiled
+// to native code with no tables (--engine=aot): each state is a block of
+// code that reads a byte and branches on it, by a compare chain or, where
+// too many byte ranges lead to different states, a jump table. The program
+// counter is the state.
+class AotDfaMatcher : public Matcher {
+public:
+    static const size_t MAX_STATES = 1024;
+
+    // `g` must hold one pattern; throws if its DFA needs more than
+    // MAX_STATES states
+    explicit AotDfaMatcher(const Glushkov& g);
+    ~AotDfaMatcher();
+
+    AotDfaMatcher(const AotDfaMatcher&) = delete;
+    AotDfaMatcher& operator=(const AotDfaMatcher&) = delete;
+
+    const char* find(const char* begin, const char* end) override;
+    void report(Stats& stats) const override;
+
+private:
+    size_t states_ = 0;
+    void* code_ = nullptr;
+    size_t code_size_ = 0;
+    bool match_all_ = false;
+};
+
+// A single regex with a DFA of at most MAX_STATES states, run on 32 lines
+// at once (--engine=lanes): the lines are transposed so that each byte of
+// an AVX2 register belongs to another line, and one step moves all 32 DFAs
+// with a byte shuffle per group of bytes leading to the same states. Each
+// batch yields a bitmask of the lines that matched. Lines longer than
+// MAX_LINE, small batches, and all lines on CPUs without AVX2 step the
+// same DFA one byte at a time.
+class LaneDfaMatcher : public Matcher {
+public:
+    static const size_t LANES = 32;
+    static const size_t MAX_STATES = 14; // plus matched and done, in 4 bits
+    static const size_t MAX_RANGES = 16; // byte ranges tested per step
+    static const size_t MAX_LINE = 256;
+
+    // `g` must hold one pattern; throws if its DFA exceeds the limits
+    explicit LaneDfaMatcher(const Glushkov& g);
+
+    const char* find(const char* begin, const char* end) override;
+    void report(Stats& stats) const override;
+
+    // The DFA, in the forms the AVX2 code and the scalar loop step it.
+    // Bytes are grouped by the transitions they take; group 0 holds most.
+    struct Range {
+        uint8_t first, last; // bytes [first, last]
+        uint8_t group;
+    };
+    struct Tables {
+        uint8_t matched;               // state after a match, and after it
+        std::vector<uint8_t> shuffles; // per group: 16 next states, by state
+        std::vector<Range> ranges;     // bytes outside group 0, by group
+        std::vector<uint8_t> next;     // per state: 256 next states, by byte
+    };
+
+private:
+    bool match_line(const char* bol, const char* eol) const;
+
+    Tables tables_;
+    size_t states_ = 0;
+    bool match_all_ = false;
+    bool avx2_;
+    size_t batch_ = LANES; // lines per batch, fewer where matches are dense
+};
+
+// Runs another matcher on one field of each line only (-d, -k): fields are
+// separated by a delimiter byte, with no quoting, as cut(1) sees them. The
+// field is handed over as a line of its own, so ^ and $ match at its ends;
+// lines with fewer fields never match.
+class FieldMatcher : public Matcher {
+public:
+    // `index` counts from 0
+    FieldMatcher(std::unique_ptr<Matcher> matcher, char delim, size_t index);
+
+    const char* find(const char* begin, const char* end) override;
+    void report(Stats& stats) const override { matcher_->report(stats); }
+    void reset_counters() override { matcher_->reset_counters(); }
+    void pattern_ids(const char* bol, const char* eol, std::vector<uint32_t>& ids) override;
+
+private:
+    // Field `index_` of the line at `bol`, as [begin, end): found if the
+    // line has that many fields. `stop` ends the scan, at the line's '\n'
+    // or the buffer's end.
+    bool field(const char* bol, const char* stop, const char*& begin, const char*& end) const;
+
+    std::unique_ptr<Matcher> matcher_;
+    char delim_;
+    size_t index_;
+    bool empty_matches_; // the pattern matches an empty field
+};
+
+// A fixed string (-F), located with a SIMD filter on its first and last
+// bytes; candidates are verified with memcmp. No parser, no JIT.
+class LiteralMatcher : public Matcher {
+public:
+    explicit LiteralMatcher(const std::string& needle);
+
+    const char* find(const char* begin, const char* end) override;
+
+private:
+    std::string needle_;
+    bool avx2_;
+};
+
+// Many fixed strings (-f), found in one pass with an Aho-Corasick automaton.
+// States are numbered breadth-first; the shallow states, where the scan
+// spends nearly all its time, get full 256-entry transition rows, while
+// deeper ones keep only their trie edges (sorted, in flat arrays) and fall
+// back along failure links. Every stored transition carries a MATCH bit,
+// so the scan loop needs no separate output lookup.
+class AhoCorasickMatcher : public Matcher {
+public:
+    explicit AhoCorasickMatcher(const std::vector<std::string>& needles);
+
+    const char* find(const char* begin, const char* end) override;
+    void report(Stats& stats) const override;
+
+private:
+    static constexpr uint32_t MATCH = 1u << 31;
+
+    uint32_t step(uint32_t state, uint8_t c) const;
+
+    bool match_all_ = false;           // an empty needle matches every line
+    uint32_t dense_states_ = 0;        // states [0, dense_states_) are dense
+    std::vector<uint32_t> dense_;      // 256 transitions per dense state
+    std::vector<uint32_t> fail_;       // per state
+    std::vector<uint32_t> edge_begin_; // per state, plus one; indexes edges
+    std::vector<uint8_t> edge_bytes_;
+    std::vector<uint32_t> edge_next_;
+};
+
+// A set of regexes run through one lazily built DFA, so that each line is
+// scanned once however many patterns there are, and every pattern that
+// matches a line can be named (--ids)
+class RegexSetMatcher : public Matcher {
+public:
+    explicit RegexSetMatcher(const std::vector<std::shared_ptr<Node>>& roots);
+
+    const char* find(const char* begin, const char* end) override;
+    void report(Stats& stats) const override;
+    void pattern_ids(const char* bol, const char* eol, std::vector<uint32_t>& ids) override;
+
+private:
+    Glushkov glushkov_;
+    LazyDfa dfa_;
+    bool match_all_; // some pattern matches every line
+};
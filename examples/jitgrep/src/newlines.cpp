@@ -0,0 +1,76 @@
+#include "newlines.h"
+#include <immintrin.h>
+
+// Each compare yields 0xFF (-1) per newline, so subtracting it counts up
+// to 255 newlines per byte lane; the lanes are then summed with psadbw
+// before they can overflow.
+static const size_t MAX_ROUNDS = 255;
+
+static size_t count_sse2(const char* p, const char* end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t count = 0;
+    while ((size_t)(end - p) >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        for (size_t r = 0; r < MAX_ROUNDS && (size_t)(end - p) >= 16; r++, p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, nl));
+        }
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += _mm_cvtsi128_si64(sums) + _mm_extract_epi16(sums, 4);
+    }
+    for (; p < end; p++) count += *p == '\n';
+    return count;
+}
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const char* p, const char* end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    while ((size_t)(end - p) >= 32) {
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t r = 0; r < MAX_ROUNDS && (size_t)(end - p) >= 32; r++, p += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, nl));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1)
+            + _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+    }
+    return count + count_sse2(p, end);
+}
+
+size_t count_newlines(const char* begin, const char* end) {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2 ? count_avx2(begin, end) : count_sse2(begin, end);
+}
+
+static const char* find_delimiter_sse2(const char* p, const char* end, char delim) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i d = _mm_set1_epi8(delim);
+    for (; (size_t)(end - p) >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, d)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    for (; p < end; p++) {
+        if (*p == '\n' || *p == delim) return p;
+    }
+    return end;
+}
+
+__attribute__((target("avx2")))
+static const char* find_delimiter_avx2(const char* p, const char* end, char delim) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i d = _mm256_set1_epi8(delim);
+    for (; (size_t)(end - p) >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, d)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return find_delimiter_sse2(p, end, delim);
+}
+
+const char* find_delimiter(const char* begin, const char* end, char delim) {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2 ? find_delimiter_avx2(begin, end, delim) : find_delimiter_sse2(begin, end, delim);
+}
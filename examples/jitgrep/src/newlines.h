@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+
+// Number of '\n' bytes in [begin, end), counted 32 or 16 bytes at a time
+size_t count_newlines(const char* begin, const char* end);
+
+// The first '\n' or `delim` in [begin, end), or `end` if there is none,
+// looked for 32 or 16 bytes at a time
+const char* find_delimiter(const char* begin, const char* end, char delim);
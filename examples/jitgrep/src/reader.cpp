@@ -0,0 +1,176 @@
+#include "reader.h"
+#include "decompress.h"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <linux/futex.h>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static void futex_wait(std::atomic<uint32_t>* addr, uint32_t val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, nullptr, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>* addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Spin this many times before going to sleep on the futex
+static const int SPIN_LIMIT = 256;
+
+BufferRing::BufferRing(size_t capacity) {
+    size_t n = 1;
+    while (n < capacity) n <<= 1;
+    slots_.resize(n);
+    mask_ = (uint32_t)(n - 1);
+}
+
+void BufferRing::push(Buffer* b) {
+    uint32_t t = tail_.load(std::memory_order_relaxed);
+    uint32_t h;
+    int spins = 0;
+    while (t - (h = head_.load(std::memory_order_acquire)) > mask_) {
+        if (++spins < SPIN_LIMIT) {
+            _mm_pause();
+            continue;
+        }
+        push_waiting_.store(1, std::memory_order_seq_cst);
+        if (t - head_.load(std::memory_order_seq_cst) > mask_) futex_wait(&head_, h);
+        push_waiting_.store(0, std::memory_order_relaxed);
+    }
+    slots_[t & mask_] = b;
+    tail_.store(t + 1, std::memory_order_seq_cst);
+    if (pop_waiting_.load(std::memory_order_seq_cst)) futex_wake(&tail_);
+}
+
+Buffer* BufferRing::pop() {
+    uint32_t h = head_.load(std::memory_order_relaxed);
+    int spins = 0;
+    while (tail_.load(std::memory_order_acquire) == h) {
+        if (++spins < SPIN_LIMIT) {
+            _mm_pause();
+            continue;
+        }
+        pop_waiting_.store(1, std::memory_order_seq_cst);
+        if (tail_.load(std::memory_order_seq_cst) == h) futex_wait(&tail_, h);
+        pop_waiting_.store(0, std::memory_order_relaxed);
+    }
+    Buffer* b = slots_[h & mask_];
+    head_.store(h + 1, std::memory_order_seq_cst);
+    if (push_waiting_.load(std::memory_order_seq_cst)) futex_wake(&head_);
+    return b;
+}
+
+// Page-aligned allocation for a Buffer
+static char* alloc_buffer(size_t capacity) {
+    void* p = nullptr;
+    if (posix_memalign(&p, 4096, capacity) != 0) throw std::bad_alloc();
+    return static_cast<char*>(p);
+}
+
+static void grow_buffer(Buffer* b, size_t used) {
+    size_t capacity = b->capacity * 2;
+    char* data = alloc_buffer(capacity);
+    memcpy(data, b->data, used);
+    free(b->data);
+    b->data = data;
+    b->capacity = capacity;
+}
+
+AsyncReader::AsyncReader(int fd, size_t buffer_size, size_t depth)
+    : fd_(fd), buffers_(depth), filled_(depth + 1), free_(depth + 1) {
+    for (auto& b : buffers_) {
+        b.data = alloc_buffer(buffer_size);
+        b.capacity = buffer_size;
+        free_.push(&b);
+    }
+    thread_ = std::thread(&AsyncReader::run, this);
+}
+
+AsyncReader::~AsyncReader() {
+    // Wake the reader if it is waiting for a free buffer. A reader blocked
+    // inside read() finishes that read first.
+    stop_ = true;
+    free_.push(nullptr);
+    thread_.join();
+    for (auto& b : buffers_) free(b.data);
+}
+
+Buffer* AsyncReader::next() {
+    if (done_) return nullptr;
+    Buffer* b = filled_.pop();
+    if (!b) {
+        done_ = true;
+        if (!error_.empty()) throw std::runtime_error(error_);
+    }
+    return b;
+}
+
+void AsyncReader::release(Buffer* b) {
+    free_.push(b);
+}
+
+void AsyncReader::run() {
+    std::vector<char> carry;
+    bool eof = false;
+    try {
+        // Sniffing the magic number reads input, so it happens here too
+        source_ = open_source(fd_);
+        while (!eof) {
+            Buffer* b = free_.pop();
+            if (!b || stop_) break;
+            try {
+                eof = fill(b, carry);
+            } catch (...) {
+                // Hand over what was decoded before the error
+                filled_.push(b);
+                throw;
+            }
+            filled_.push(b);
+        }
+    } catch (const std::exception& e) {
+        error_ = e.what();
+    }
+    filled_.push(nullptr);
+}
+
+// Fill `b` starting with the partial line carried over from the previous
+// buffer. Keeps reading while input is immediately available, then hands
+// over everything up to the last newline. Returns true at end of input.
+bool AsyncReader::fill(Buffer* b, std::vector<char>& carry) {
+    size_t len = carry.size();
+    while (b->capacity < len) grow_buffer(b, 0);
+    memcpy(b->data, carry.data(), len);
+    carry.clear();
+
+    // Bytes before `searched` hold no '\n' (the carry is part of a line), so
+    // a long line arriving in small reads is only searched once
+    size_t searched = len;
+    char* last_nl = nullptr;
+    for (;;) {
+        if (len == b->capacity) {
+            if ((last_nl = static_cast<char*>(memrchr(b->data + searched, '\n', len - searched)))) break;
+            searched = len;
+            grow_buffer(b, len); // a single line longer than the buffer
+        }
+
+        b->size = len;
+        size_t n = source_->read(b->data + len, b->capacity - len);
+        if (n == 0) return true;
+        len += n;
+
+        // More input already waiting: keep filling rather than handing the
+        // matcher a small buffer
+        if (len < b->capacity && source_->ready()) continue;
+        if ((last_nl = static_cast<char*>(memrchr(b->data + searched, '\n', len - searched)))) break;
+        searched = len;
+    }
+
+    b->size = last_nl + 1 - b->data;
+    carry.assign(last_nl + 1, b->data + len);
+    return false;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A block of input handed from the reader thread to the matcher.
+// The reader only hands over whole lines: `size` ends just past the last
+// '\n' (or at EOF), so no line is ever split across two buffers.
+struct Buffer {
+    char* data = nullptr;
+    size_t capacity = 0;
+    size_t size = 0;
+};
+
+// Where the reader thread gets its bytes: a plain file descriptor, or a
+// decompressor wrapped around one (see decompress.h).
+class Source {
+public:
+    virtual ~Source() = default;
+
+    // Like read(2): stores up to `cap` bytes, returns 0 at end of input.
+    // Throws on I/O errors and corrupt input.
+    virtual size_t read(char* dst, size_t cap) = 0;
+
+    // True if read() can return more data right away
+    virtual bool ready() = 0;
+};
+
+// Lock-free single-producer/single-consumer queue of buffer pointers.
+// push() and pop() spin briefly and then sleep on a futex, so an idle side
+// costs nothing and a busy side never makes a syscall.
+class BufferRing {
+public:
+    explicit BufferRing(size_t capacity);
+
+    // Blocks while the ring is full
+    void push(Buffer* b);
+
+    // Blocks while the ring is empty
+    Buffer* pop();
+
+private:
+    std::vector<Buffer*> slots_;
+    uint32_t mask_;
+    alignas(64) std::atomic<uint32_t> head_{0};      // next slot to pop
+    alignas(64) std::atomic<uint32_t> tail_{0};      // next slot to push
+    alignas(64) std::atomic<uint32_t> pop_waiting_{0};
+    std::atomic<uint32_t> push_waiting_{0};
+};
+
+// Reads a file descriptor on a background thread into a small pool of large,
+// page-aligned buffers, so that matching one buffer overlaps with reading
+// the next. Buffers travel reader -> matcher through `filled_` and back
+// through `free_`. gzip and zstd input is decompressed on the same thread,
+// so decoding also runs ahead of the matcher.
+class AsyncReader {
+public:
+    explicit AsyncReader(int fd, size_t buffer_size = 1 << 20, size_t depth = 4);
+    ~AsyncReader();
+
+    AsyncReader(const AsyncReader&) = delete;
+    AsyncReader& operator=(const AsyncReader&) = delete;
+
+    // Next buffer of whole lines, or nullptr at end of input.
+    // Throws if reading or decompressing failed.
+    Buffer* next();
+
+    // Hand a consumed buffer back to the reader for refilling.
+    void release(Buffer* b);
+
+private:
+    void run();
+    bool fill(Buffer* b, std::vector<char>& carry);
+
+    int fd_;
+    std::unique_ptr<Source> source_;
+    std::vector<Buffer> buffers_;
+    BufferRing filled_;
+    BufferRing free_;
+    std::atomic<bool> stop_{false};
+    bool done_ = false;
+    std::string error_;
+    std::thread thread_;
+};
@@ -10,11 +10,25 @@ enum NodeType {
     NODE_STAR,
     NODE_OR,
     NODE_START, // ^
-    NODE_END    // $
+    NODE_END,   // $
+    NODE_ATOMIC, // (?>...)
+    NODE_GROUP   // (...)
+};
+
+// How a star repeats: as often as possible, giving iterations back when
+// the rest fails (x*); as rarely as possible (x*?); or as often as
+// possible, never giving back (x*+)
+enum StarMode {
+    STAR_GREEDY,
+    STAR_LAZY,
+    STAR_POSSESSIVE
 };
 
 struct Node {
     NodeType type;
+    // Span of the pattern this node was parsed from, [begin, end)
+    size_t begin = 0;
+    size_t end = 0;
     virtual ~Node() = default;
 };
 
@@ -35,7 +49,8 @@ struct ConcatNode : public Node {
 
 struct StarNode : public Node {
     std::shared_ptr<Node> child;
-    StarNode(std::shared_ptr<Node> c) : child(c) { type = NODE_STAR; }
+    StarMode mode;
+    StarNode(std::shared_ptr<Node> c, StarMode m = STAR_GREEDY) : child(c), mode(m) { type = NODE_STAR; }
 };
 
 struct OrNode : public Node {
@@ -52,4 +67,30 @@ struct EndNode : public Node {
     EndNode() { type = NODE_END; }
 };
 
+// Matches like its child, but once the child has matched, later failures
+// never come back to try it another way
+struct AtomicNode : public Node {
+    std::shared_ptr<Node> child;
+    AtomicNode(std::shared_ptr<Node> c) : child(c) { type = NODE_ATOMIC; }
+};
+
+// A parenthesized subpattern, which matches like its child. Groups are
+// numbered from 1 in the order of their opening parentheses; engines that
+// report where they matched (JitOptions::captures) go by that number.
+struct GroupNode : public Node {
+    std::shared_ptr<Node> child; // null for ()
+    int index;
+    GroupNode(std::shared_ptr<Node> c, int i) : child(c), index(i) { type = NODE_GROUP; }
+};
+
 std::shared_ptr<Node> parse_regex(const std::string& pattern);
+
+// The regex matching exactly `text`; null if it is empty
+std::shared_ptr<Node> literal_regex(const std::string& text);
+
+// True if `root` has possessive stars or atomic groups. They change which
+// lines match, and only the backtracking JIT implements them.
+bool needs_backtracking(const Node* root);
+
+// The number of groups in `root`, which is also the highest group index
+int group_count(const Node* root);
@@ -20,6 +20,7 @@ public:
 private:
     std::string pattern_;
     size_t pos_;
+    int groups_ = 0;
 
     char peek() const {
         if (pos_ < pattern_.length()) {
@@ -35,19 +36,30 @@ private:
         return '\0';
     }
 
+    // Record that `node` was parsed from [begin, pos_)
+    std::shared_ptr<Node> spanned(std::shared_ptr<Node> node, size_t begin) {
+        if (node) {
+            node->begin = begin;
+            node->end = pos_;
+        }
+        return node;
+    }
+
     // Lowest precedence: |
     std::shared_ptr<Node> parseOr() {
+        size_t begin = pos_;
         auto node = parseConcat();
         while (peek() == '|') {
             advance(); // consume '|'
             auto right = parseConcat();
-            node = std::make_shared<OrNode>(node, right);
+            node = spanned(std::make_shared<OrNode>(node, right), begin);
         }
         return node;
     }
 
     // Mid precedence: Concatenation (implicit)
     std::shared_ptr<Node> parseConcat() {
+        size_t begin = pos_;
         std::shared_ptr<Node> node = nullptr;
 
         while (pos_ < pattern_.length() && peek() != '|' && peek() != ')') {
@@ -55,50 +67,65 @@ private:
             if (!node) {
                 node = next;
             } else {
-                node = std::make_shared<ConcatNode>(node, next);
+                node = spanned(std::make_shared<ConcatNode>(node, next), begin);
             }
         }
 
         return node;
     }
 
-    // High precedence: *
+    // High precedence: *, and its lazy *? and possessive *+ forms
     std::shared_ptr<Node> parseStar() {
+        size_t begin = pos_;
         auto node = parsePrimary();
         while (peek() == '*') {
             advance(); // consume '*'
             if (node == nullptr) {
                 throw std::runtime_error("Nothing to repeat before *");
             }
-            node = std::make_shared<StarNode>(node);
+            StarMode mode = STAR_GREEDY;
+            if (peek() == '?') {
+                advance();
+                mode = STAR_LAZY;
+            } else if (peek() == '+') {
+                advance();
+                mode = STAR_POSSESSIVE;
+            }
+            node = spanned(std::make_shared<StarNode>(node, mode), begin);
         }
         return node;
     }
 
     // Highest precedence: atoms, (), ^, $, .
     std::shared_ptr<Node> parsePrimary() {
+        size_t begin = pos_;
         char c = peek();
         if (c == '(') {
             advance(); // consume '('
+            bool atomic = pattern_.compare(pos_, 2, "?>") == 0;
+            if (atomic) pos_ += 2;
+            int index = atomic ? 0 : ++groups_;
             auto node = parseOr();
             if (advance() != ')') {
                 throw std::runtime_error("Unbalanced parentheses");
             }
-            return node;
+            if (!atomic) return spanned(std::make_shared<GroupNode>(node, index), begin);
+            if (node) node = std::make_shared<AtomicNode>(node);
+            return spanned(node, begin); // include the parentheses
         } else if (c == '.') {
             advance();
-            return std::make_shared<AnyNode>();
+            return spanned(std::make_shared<AnyNode>(), begin);
         } else if (c == '^') {
             advance();
-            return std::make_shared<StartNode>();
+            return spanned(std::make_shared<StartNode>(), begin);
         } else if (c == '$') {
             advance();
-            return std::make_shared<EndNode>();
+            return spanned(std::make_shared<EndNode>(), begin);
         } else if (c == '\\') {
             advance(); // consume '\'
             char escaped = advance();
             if (escaped == '\0') throw std::runtime_error("Trailing backslash");
-            return std::make_shared<CharNode>(escaped);
+            return spanned(std::make_shared<CharNode>(escaped), begin);
         } else if (c == '*' || c == '|' || c == ')') {
             // These characters are syntactically significant and handled by callers.
             // If they appear here unexpectedly, it may be an empty branch of Or or Concat.
@@ -107,7 +134,7 @@ private:
             return nullptr;
         } else {
             advance();
-            return std::make_shared<CharNode>(c);
+            return spanned(std::make_shared<CharNode>(c), begin);
         }
     }
 };
@@ -116,3 +143,65 @@ std::shared_ptr<Node> parse_regex(const std::string& pattern) {
     RegexParser parser(pattern);
     return parser.parse();
 }
+
+bool needs_backtracking(const Node* root) {
+    if (!root) return false;
+    switch (root->type) {
+        case NODE_ATOMIC:
+            return true;
+        case NODE_STAR: {
+            auto* star = static_cast<const StarNode*>(root);
+            return star->mode == STAR_POSSESSIVE || needs_backtracking(star->child.get());
+        }
+        case NODE_CONCAT: {
+            auto* concat = static_cast<const ConcatNode*>(root);
+            return needs_backtracking(concat->left.get()) || needs_backtracking(concat->right.get());
+        }
+        case NODE_OR: {
+            auto* alt = static_cast<const OrNode*>(root);
+            return needs_backtracking(alt->left.get()) || needs_backtracking(alt->right.get());
+        }
+        case NODE_GROUP:
+            return needs_backtracking(static_cast<const GroupNode*>(root)->child.get());
+        default:
+            return false;
+    }
+}
+
+int group_count(const Node* root) {
+    if (!root) return 0;
+    switch (root->type) {
+        case NODE_STAR:
+            return group_count(static_cast<const StarNode*>(root)->child.get());
+        case NODE_ATOMIC:
+            return group_count(static_cast<const AtomicNode*>(root)->child.get());
+        case NODE_GROUP:
+            return 1 + group_count(static_cast<const GroupNode*>(root)->child.get());
+        case NODE_CONCAT: {
+            auto* concat = static_cast<const ConcatNode*>(root);
+            return group_count(concat->left.get()) + group_count(concat->right.get());
+        }
+        case NODE_OR: {
+            auto* alt = static_cast<const OrNode*>(root);
+            return group_count(alt->left.get()) + group_count(alt->right.get());
+        }
+        default:
+            return 0;
+    }
+}
+
+std::shared_ptr<Node> literal_regex(const std::string& text) {
+    std::shared_ptr<Node> node;
+    for (size_t i = 0; i < text.size(); i++) {
+        auto c = std::make_shared<CharNode>(text[i]);
+        c->begin = i;
+        c->end = i + 1;
+        if (!node) {
+            node = c;
+        } else {
+            node = std::make_shared<ConcatNode>(node, c);
+            node->end = i + 1;
+        }
+    }
+    return node;
+}
@@ -0,0 +1,298 @@
+#include "server.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <streambuf>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+// Requests travel over SOCK_SEQPACKET, which keeps messages and the
+// descriptors attached to them together:
+//
+//   client -> server  the arguments, NUL-terminated, with its stdout and
+//                     stderr attached
+//   client -> server  per input, an int32 errno: 0 with the descriptor
+//                     attached, or why the file could not be opened
+//   server -> client  the int32 exit status, once all output is written
+
+// Arguments beyond this size are refused
+static const size_t MAX_ARGS = 256 * 1024;
+
+static const size_t OUTPUT_BUFFER = 64 * 1024;
+
+// Send `size` bytes with the descriptors `fds` attached
+static bool send_message(int sock, const void* data, size_t size, const std::vector<int>& fds) {
+    iovec iov = {const_cast<void*>(data), size};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    std::vector<char> control;
+    if (!fds.empty()) {
+        control.resize(CMSG_SPACE(fds.size() * sizeof(int)));
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+        memcpy(CMSG_DATA(c), fds.data(), fds.size() * sizeof(int));
+    }
+    for (;;) {
+        if (sendmsg(sock, &msg, MSG_NOSIGNAL) >= 0) return true;
+        if (errno != EINTR) return false;
+    }
+}
+
+// Receive one message into `data` and the descriptors attached to it into
+// `fds`. Returns its size, 0 at end of connection, or -1 on error.
+static ssize_t receive_message(int sock, void* data, size_t size, std::vector<int>& fds) {
+    iovec iov = {data, size};
+    alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int))];
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+
+    fds.clear();
+    for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof fd);
+            fds.push_back(fd);
+        }
+    }
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        for (int fd : fds) close(fd);
+        fds.clear();
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return n;
+}
+
+static sockaddr_un socket_address(const char* path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        throw std::runtime_error(std::string(path) + ": socket path too long");
+    }
+    strcpy(addr.sun_path, path);
+    return addr;
+}
+
+// An ostream buffer over a descriptor the server does not own
+class FdBuf : public std::streambuf {
+public:
+    explicit FdBuf(int fd) : fd_(fd), buf_(OUTPUT_BUFFER) { setp(buf_.data(), buf_.data() + buf_.size()); }
+    ~FdBuf() { sync(); }
+
+protected:
+    int overflow(int c) override {
+        if (sync() != 0) return traits_type::eof();
+        if (c != traits_type::eof()) {
+            *pptr() = static_cast<char>(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        const char* p = pbase();
+        while (p < pptr()) {
+            ssize_t n = write(fd_, p, pptr() - p);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                setp(buf_.data(), buf_.data() + buf_.size());
+                return -1;
+            }
+            p += n;
+        }
+        setp(buf_.data(), buf_.data() + buf_.size());
+        return 0;
+    }
+
+private:
+    int fd_;
+    std::vector<char> buf_;
+};
+
+std::unique_ptr<Compiled> CompiledCache::take(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second->idle.empty()) return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    std::unique_ptr<Compiled> compiled = std::move(it->second->idle.back());
+    it->second->idle.pop_back();
+    return compiled;
+}
+
+void CompiledCache::put(const std::string& key, std::unique_ptr<Compiled> compiled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        lru_.push_front(Entry{key, {}});
+        it = entries_.emplace(key, lru_.begin()).first;
+        if (lru_.size() > capacity_) {
+            entries_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+    } else {
+        lru_.splice(lru_.begin(), lru_, it->second);
+    }
+    it->second->idle.push_back(std::move(compiled));
+}
+
+int Request::next_input() {
+    int32_t error;
+    std::vector<int> fds;
+    ssize_t n = receive_message(socket_, &error, sizeof error, fds);
+    if (n != sizeof error || (error == 0) != (fds.size() == 1)) {
+        for (int fd : fds) close(fd);
+        errno = n < 0 ? errno : EPROTO;
+        return -1;
+    }
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return fds[0];
+}
+
+// Run the search sent on the connection `sock`
+static void handle(int sock, const Handler& handler) {
+    std::vector<char> data(MAX_ARGS);
+    std::vector<int> fds;
+    ssize_t n = receive_message(sock, data.data(), data.size(), fds);
+    if (n <= 0 || fds.size() != 2 || data[n - 1] != '\0') {
+        for (int fd : fds) close(fd);
+        return;
+    }
+
+    std::vector<std::string> args;
+    for (const char* p = data.data(); p < data.data() + n; p += strlen(p) + 1) args.push_back(p);
+
+    int status;
+    {
+        FdBuf out_buf(fds[0]), err_buf(fds[1]);
+        std::ostream out(&out_buf), err(&err_buf);
+        Request request(sock, std::move(args), out, err);
+        try {
+            status = handler(request);
+        } catch (const std::exception& e) {
+            err << "Error: " << e.what() << std::endl;
+            status = 1;
+        }
+        out.flush();
+        err.flush();
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    int32_t result = status;
+    send_message(sock, &result, sizeof result, {});
+}
+
+void serve(const char* path, const Handler& handler) {
+    // A client that goes away must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    // Descriptors received from clients are closed after use, so none of
+    // them may land on the standard ones
+    for (int fd = 0; fd <= 2; fd++) {
+        if (fcntl(fd, F_GETFD) < 0) open("/dev/null", O_RDWR);
+    }
+
+    sockaddr_un addr = socket_address(path);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) throw std::runtime_error(std::string("socket: ") + strerror(errno));
+
+    // A socket left over by an earlier server is replaced
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 || listen(sock, SOMAXCONN) != 0) {
+        throw std::runtime_error(std::string(path) + ": " + strerror(errno));
+    }
+
+    auto worker = [&] {
+        for (;;) {
+            int conn = accept4(sock, nullptr, nullptr, SOCK_CLOEXEC);
+            if (conn < 0) {
+                if (errno != EINTR && errno != ECONNABORTED) {
+                    std::cerr << "Error: accept: " << strerror(errno) << std::endl;
+                }
+                continue;
+            }
+            handle(conn, handler);
+            close(conn);
+        }
+    };
+    std::vector<std::thread> workers(std::max(1u, std::thread::hardware_concurrency()));
+    for (std::thread& t : workers) t = std::thread(worker);
+    for (std::thread& t : workers) t.join();
+}
+
+int run_client(const char* path, int argc, char** argv, const std::vector<const char*>& files) {
+    sockaddr_un addr = socket_address(path);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) throw std::runtime_error(std::string("socket: ") + strerror(errno));
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        int error = errno;
+        close(sock);
+        throw std::runtime_error(std::string(path) + ": " + strerror(error));
+    }
+
+    std::string args;
+    for (int i = 1; i < argc; i++) {
+        args += argv[i];
+        args += '\0';
+    }
+    bool sent = args.size() <= MAX_ARGS
+        && send_message(sock, args.data(), args.size(), {STDOUT_FILENO, STDERR_FILENO});
+
+    // Inputs are opened here, with this process's permissions and working
+    // directory. The server stops reading them if the search fails early,
+    // so a failed send is not an error in itself: the status says.
+    auto send_input = [&](int fd, int32_t error) {
+        if (!sent) return;
+        sent = send_message(sock, &error, sizeof error, fd >= 0 ? std::vector<int>{fd} : std::vector<int>{});
+    };
+    if (files.empty()) send_input(STDIN_FILENO, 0);
+    for (const char* name : files) {
+        if (strcmp(name, "-") == 0) {
+            send_input(STDIN_FILENO, 0);
+            continue;
+        }
+        int fd = open(name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            send_input(-1, errno);
+            continue;
+        }
+        send_input(fd, 0);
+        close(fd);
+    }
+
+    int32_t status;
+    ssize_t n;
+    do {
+        n = recv(sock, &status, sizeof status, 0);
+    } while (n < 0 && errno == EINTR);
+    close(sock);
+    if (n != sizeof status) throw std::runtime_error(std::string(path) + ": server closed the connection");
+    return status;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "matcher.h"
+#include "stream.h"
+#include "substitute.h"
+
+// The engines compiled for one search
+struct Compiled {
+    std::unique_ptr<Matcher> matcher;
+    std::unique_ptr<StreamMatcher> stream;
+    std::unique_ptr<Substituter> substituter; // over matcher, with -s
+};
+
+// Compiled engines kept between searches, under a key naming the patterns
+// and every option that shapes their code. Engines are never shared: a
+// search takes one out for its duration and puts it back afterwards, so
+// searches running at once on the same key compile one each the first
+// time. Past `capacity` keys the least recently used one is dropped.
+class CompiledCache {
+public:
+    explicit CompiledCache(size_t capacity) : capacity_(capacity) {}
+
+    CompiledCache(const CompiledCache&) = delete;
+    CompiledCache& operator=(const CompiledCache&) = delete;
+
+    // An idle engine for `key`, or nullptr if there is none
+    std::unique_ptr<Compiled> take(const std::string& key);
+
+    // Keep `compiled` for the next search on `key`
+    void put(const std::string& key, std::unique_ptr<Compiled> compiled);
+
+private:
+    struct Entry {
+        std::string key;
+        std::vector<std::unique_ptr<Compiled>> idle;
+    };
+
+    size_t capacity_;
+    std::mutex mutex_;
+    std::list<Entry> lru_; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+};
+
+// A search sent to the server by a client (--connect). Its output goes
+// straight to the client's stdout and stderr, passed over the socket.
+class Request {
+public:
+    Request(int socket, std::vector<std::string> args, std::ostream& out, std::ostream& err)
+        : args(std::move(args)), out(out), err(err), socket_(socket) {}
+
+    std::vector<std::string> args; // the client's argv, without argv[0]
+    std::ostream& out;
+    std::ostream& err;
+
+    // The client's next input: a descriptor it opened for the next file
+    // operand (or its stdin), or -1 with errno set if it could not. The
+    // caller owns the descriptor.
+    int next_input();
+
+private:
+    int socket_;
+};
+
+// Runs a search and returns its exit status
+using Handler = std::function<int(Request&)>;
+
+// Accept searches on the Unix socket `path` and run them with `handler`,
+// one per worker thread at a time; never returns (--serve)
+void serve(const char* path, const Handler& handler);
+
+// Have the server at `path` run the search in `argv`, opening `files` here
+// (stdin if there are none) for it, and return its exit status (--connect)
+int run_client(const char* path, int argc, char** argv, const std::vector<const char*>& files);
@@ -0,0 +1,42 @@
+#include "matcher.h"
+#include <algorithm>
+
+RegexSetMatcher::RegexSetMatcher(const std::vector<std::shared_ptr<Node>>& roots)
+    : glushkov_(roots), dfa_(glushkov_) {
+    match_all_ = !glushkov_.nullable.empty() || !dfa_.accepts(dfa_.start()).empty();
+}
+
+const char* RegexSetMatcher::find(const char* begin, const char* end) {
+    if (match_all_) return begin;
+
+    uint32_t s = dfa_.start();
+    for (const char* p = begin; p < end; p++) {
+        s = dfa_.next(s, dfa_.byte_class((uint8_t)*p));
+        if (s & LazyDfa::MATCH) return p;
+    }
+
+    // A final line without a newline still ends in EOL
+    if (begin < end && end[-1] != '\n' && !dfa_.eol_accepts(s).empty()) return end - 1;
+    return end;
+}
+
+void RegexSetMatcher::pattern_ids(const char* bol, const char* eol, std::vector<uint32_t>& ids) {
+    ids = glushkov_.nullable;
+    uint32_t s = dfa_.start();
+    auto add = [&](const std::vector<uint32_t>& accepts) {
+        ids.insert(ids.end(), accepts.begin(), accepts.end());
+    };
+    add(dfa_.accepts(s));
+    for (const char* p = bol; p < eol; p++) {
+        s = dfa_.next(s, dfa_.byte_class((uint8_t)*p)) & ~LazyDfa::MATCH;
+        add(dfa_.accepts(s));
+    }
+    add(dfa_.eol_accepts(s));
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+void RegexSetMatcher::report(Stats& stats) const {
+    stats.automaton_states = dfa_.state_count();
+    stats.automaton_size = dfa_.memory();
+}
@@ -0,0 +1,65 @@
+#include "stats.h"
+#include <iomanip>
+
+static double throughput_mb_s(const Stats& s) {
+    return s.scan_ms > 0 ? s.bytes_scanned / (s.scan_ms * 1000.0) : 0;
+}
+
+void Stats::print_text(std::ostream& out) const {
+    out << std::fixed << std::setprecision(3)
+        << "parse time:      " << parse_ms << " ms\n"
+        << "codegen time:    " << codegen_ms << " ms\n"
+        << "code size:       " << code_size << " bytes\n"
+        << "code arena:      " << arena_chunks << " chunks, " << arena_syscalls << " syscalls to compile\n";
+    if (automaton_states) {
+        out << "automaton:       " << automaton_states << " states, " << automaton_size << " bytes\n";
+    }
+    if (indexed) {
+        out << "index lookup:    " << index_ms << " ms, " << files_searched << " of "
+            << files_indexed << " files searched\n";
+    }
+    out << "scan time:       " << scan_ms << " ms\n"
+        << "  io wait:       " << io_wait_ms << " ms\n"
+        << "bytes scanned:   " << bytes_scanned << "\n"
+        << "lines scanned:   " << lines_scanned << "\n"
+        << "lines matched:   " << lines_matched << "\n"
+        << "jit entries:     " << jit_entries << "\n";
+    if (frames_counted) {
+        out << "frames pushed:   " << frames_pushed << "\n";
+    }
+    if (recompiles) {
+        out << "recompiles:      " << recompiles << "\n";
+    }
+    out << "throughput:      " << throughput_mb_s(*this) << " MB/s\n";
+}
+
+void Stats::print_json(std::ostream& out) const {
+    out << std::fixed << std::setprecision(3)
+        << "{\"parse_ms\":" << parse_ms
+        << ",\"codegen_ms\":" << codegen_ms
+        << ",\"code_size\":" << code_size
+        << ",\"arena_chunks\":" << arena_chunks
+        << ",\"arena_syscalls\":" << arena_syscalls;
+    if (automaton_states) {
+        out << ",\"automaton_states\":" << automaton_states
+            << ",\"automaton_size\":" << automaton_size;
+    }
+    if (indexed) {
+        out << ",\"index_ms\":" << index_ms
+            << ",\"files_indexed\":" << files_indexed
+            << ",\"files_searched\":" << files_searched;
+    }
+    out << ",\"scan_ms\":" << scan_ms
+        << ",\"io_wait_ms\":" << io_wait_ms
+        << ",\"bytes_scanned\":" << bytes_scanned
+        << ",\"lines_scanned\":" << lines_scanned
+        << ",\"lines_matched\":" << lines_matched
+        << ",\"jit_entries\":" << jit_entries;
+    if (frames_counted) {
+        out << ",\"frames_pushed\":" << frames_pushed;
+    }
+    if (recompiles) {
+        out << ",\"recompiles\":" << recompiles;
+    }
+    out << ",\"throughput_mb_s\":" << throughput_mb_s(*this) << "}\n";
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Counters and phase timings reported by --stats
+struct Stats {
+    double parse_ms = 0;
+    double codegen_ms = 0;
+    double scan_ms = 0;
+    double io_wait_ms = 0; // part of scan_ms spent waiting for input
+    bool indexed = false;  // files picked by --index
+    double index_ms = 0;
+    uint64_t files_indexed = 0;
+    uint64_t files_searched = 0;
+    size_t code_size = 0;
+    size_t automaton_states = 0; // for table-driven engines
+    size_t automaton_size = 0;   // bytes
+    size_t arena_chunks = 0;     // code arena chunks mapped
+    uint64_t arena_syscalls = 0; // code arena calls made while compiling
+    uint64_t bytes_scanned = 0;
+    uint64_t lines_scanned = 0;
+    uint64_t lines_matched = 0;
+    uint64_t jit_entries = 0;
+    bool frames_counted = false;
+    uint64_t frames_pushed = 0;
+    uint64_t recompiles = 0; // profile-guided (--pgo)
+
+    void print_text(std::ostream& out) const;
+    void print_json(std::ostream& out) const;
+};
+
+// Milliseconds elapsed since `start`
+inline double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
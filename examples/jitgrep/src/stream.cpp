@@ -0,0 +1,99 @@
+#include "stream.h"
+#include "decompress.h"
+#include "newlines.h"
+#include <cstring>
+
+static const size_t CHUNK_SIZE = 1 << 20;
+
+StreamMatcher::StreamMatcher(const std::vector<std::shared_ptr<Node>>& roots)
+    : glushkov_(roots), dfa_(glushkov_) {
+    match_all_ = !glushkov_.nullable.empty() || !dfa_.accepts(dfa_.start()).empty();
+    state_ = dfa_.start();
+}
+
+void StreamMatcher::feed(const char* data, size_t size, const Report& report) {
+    const char* p = data;
+    const char* end = data + size;
+    uint64_t base = offset_;
+    offset_ += size;
+
+    uint32_t s = state_;
+    while (p < end) {
+        if (matched_) {
+            // Nothing more to learn about this line
+            const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!nl) break;
+            p = nl + 1;
+            line_ = base + (p - data);
+            matched_ = false;
+            s = dfa_.start();
+            continue;
+        }
+        if (match_all_) {
+            report({line_, line_});
+            matched_ = true;
+            continue;
+        }
+
+        for (; p < end; p++) {
+            s = dfa_.next(s, dfa_.byte_class((uint8_t)*p));
+            if (s & LazyDfa::MATCH) break;
+            if (*p == '\n') line_ = base + (p - data) + 1;
+        }
+        if (p == end) break;
+
+        s &= ~LazyDfa::MATCH;
+        if (*p == '\n') {
+            // The line that just ended matched at EOL; `s` is already the
+            // start of the next one
+            report({line_, base + (p - data)});
+            line_ = base + (p - data) + 1;
+        } else {
+            report({line_, base + (p - data) + 1});
+            matched_ = true;
+        }
+        p++;
+    }
+    state_ = s;
+}
+
+void StreamMatcher::finish(const Report& report) {
+    if (!matched_ && !match_all_ && offset_ > line_ && !dfa_.eol_accepts(state_).empty()) {
+        report({line_, offset_});
+    }
+    state_ = dfa_.start();
+    offset_ = 0;
+    line_ = 0;
+    matched_ = false;
+}
+
+void StreamMatcher::report(Stats& stats) const {
+    stats.automaton_states = dfa_.state_count();
+    stats.automaton_size = dfa_.memory();
+}
+
+void stream_offsets(StreamMatcher& matcher, int fd, const char* label, Stats& stats, std::ostream& out) {
+    auto source = open_source(fd);
+    std::vector<char> chunk(CHUNK_SIZE);
+    bool last_nl = true;
+    auto print = [&](const StreamMatcher::Match& m) {
+        stats.lines_matched++;
+        if (label) out << label << ':';
+        out << m.line << ',' << m.end << '\n';
+    };
+    try {
+        while (size_t n = source->read(chunk.data(), chunk.size())) {
+            stats.bytes_scanned += n;
+            stats.lines_scanned += count_newlines(chunk.data(), chunk.data() + n);
+            last_nl = chunk[n - 1] == '\n';
+            matcher.feed(chunk.data(), n, print);
+            out.flush();
+        }
+    } catch (...) {
+        matcher.finish([](const StreamMatcher::Match&) {}); // ready for the next input
+        throw;
+    }
+    if (!last_nl) stats.lines_scanned++;
+    matcher.finish(print);
+    out.flush();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "dfa.h"
+#include "glushkov.h"
+#include "regex.h"
+#include "stats.h"
+
+// Matches regexes over input handed over in chunks of any size, with no
+// regard for line boundaries: the DFA state is carried from one chunk to
+// the next, so nothing is buffered and memory stays bounded by the chunk
+// and the DFA cache however long the lines get. Matches are reported by
+// absolute offset from the start of the input.
+class StreamMatcher {
+public:
+    // A matching line: the offset it starts at, and the offset just past
+    // the end of its earliest-ending match
+    struct Match {
+        uint64_t line;
+        uint64_t end;
+    };
+    using Report = std::function<void(const Match&)>;
+
+    explicit StreamMatcher(const std::vector<std::shared_ptr<Node>>& roots);
+
+    StreamMatcher(const StreamMatcher&) = delete;
+    StreamMatcher& operator=(const StreamMatcher&) = delete;
+
+    // Scan the next `size` bytes of input, reporting each line that is
+    // found to match as soon as it is
+    void feed(const char* data, size_t size, const Report& report);
+
+    // End of input: a last line without a newline can still match at EOL.
+    // Afterwards the matcher is ready for a new input at offset 0.
+    void finish(const Report& report);
+
+    // Bytes fed since the start of the input
+    uint64_t offset() const { return offset_; }
+
+    void report(Stats& stats) const;
+
+private:
+    Glushkov glushkov_;
+    LazyDfa dfa_;
+    bool match_all_ = false;
+
+    // Per input
+    uint32_t state_;
+    uint64_t offset_ = 0;
+    uint64_t line_ = 0;     // offset of the current line
+    bool matched_ = false;  // the current line was reported already
+};
+
+// Scan `fd` (decompressing gzip and zstd) in fixed-size chunks and print
+// "START,END" for each matching line, as reported by `matcher`, prefixed by
+// `label` when set (--stream)
+void stream_offsets(StreamMatcher& matcher, int fd, const char* label, Stats& stats, std::ostream& out);
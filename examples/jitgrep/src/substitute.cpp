@@ -0,0 +1,124 @@
+#include "substitute.h"
+#include "glushkov.h"
+#include "reader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+Substituter::Substituter(Matcher& finder, std::shared_ptr<Node> root, const std::string& replacement)
+    : finder_(finder) {
+    int groups = group_count(root.get());
+    auto literal = [&](char c) {
+        if (pieces_.empty() || pieces_.back().group >= 0) pieces_.push_back({"", -1});
+        pieces_.back().text += c;
+    };
+    for (size_t i = 0; i < replacement.size(); i++) {
+        char c = replacement[i];
+        if (c == '&') {
+            pieces_.push_back({"", 0});
+        } else if (c != '\\') {
+            literal(c);
+        } else if (++i == replacement.size()) {
+            throw std::runtime_error("trailing backslash in replacement");
+        } else if (replacement[i] >= '0' && replacement[i] <= '9') {
+            int group = replacement[i] - '0';
+            if (group > groups) {
+                throw std::runtime_error("replacement refers to group " + std::to_string(group) + ", but the pattern has "
+                                         + std::to_string(groups));
+            }
+            pieces_.push_back({"", group});
+        } else {
+            literal(replacement[i] == 'n' ? '\n' : replacement[i]);
+        }
+    }
+
+    // Matches of nullable patterns, and of those starting with an anchor or
+    // ., may start anywhere; the others only at the bytes of their first
+    // positions. Possessive stars and atomic groups keep Glushkov out.
+    starts_.fill(true);
+    try {
+        Glushkov g({root});
+        if (g.nullable.empty()) {
+            anywhere_ = std::any_of(g.first.begin(), g.first.end(), [&](uint32_t p) { return g.symbol[p] >= 256; });
+        }
+        if (!anywhere_) {
+            starts_.fill(false);
+            for (uint32_t p : g.first) starts_[g.symbol[p]] = true;
+            if (std::count(starts_.begin(), starts_.end(), true) == 1) {
+                single_start_ = std::find(starts_.begin(), starts_.end(), true) - starts_.begin();
+            }
+        }
+    } catch (const std::runtime_error&) {
+    }
+
+    JitOptions options;
+    options.captures = true;
+    jit_.compile(root, options);
+    captures_.resize(2 * (groups + 1));
+}
+
+void Substituter::run(int fd, Stats& stats, std::ostream& out) {
+    AsyncReader reader(fd);
+    for (;;) {
+        auto wait_start = Clock::now();
+        Buffer* buf = reader.next();
+        stats.io_wait_ms += ms_since(wait_start);
+        if (!buf) break;
+
+        const char* p = buf->data;
+        const char* end = buf->data + buf->size;
+        const char* copied = p; // input before this is already printed
+        stats.bytes_scanned += buf->size;
+        while (p < end) {
+            const char* hit = finder_.find(p, end);
+            if (hit == end) break;
+            const char* bol = static_cast<const char*>(memrchr(p, '\n', hit - p));
+            bol = bol ? bol + 1 : p;
+            const char* eol = static_cast<const char*>(memchr(hit, '\n', end - hit));
+            if (!eol) eol = end;
+            substitute(bol, eol, copied, out);
+            stats.lines_matched++;
+            p = eol + 1;
+        }
+        out.write(copied, end - copied);
+        out.flush();
+        reader.release(buf);
+    }
+}
+
+// Print the line [bol, eol) up to its last match to `out`, with matches
+// replaced, starting from `copied`
+void Substituter::substitute(const char* bol, const char* eol, const char*& copied, std::ostream& out) {
+    // An empty match right where the previous match ended does not count,
+    // as with sed: s/x*/-/g turns "xa" into "-a-"
+    const char* last_end = nullptr;
+    for (const char* t = bol; t <= eol; t++) {
+        if (!anywhere_) {
+            if (single_start_ >= 0) {
+                t = static_cast<const char*>(memchr(t, single_start_, eol - t));
+                if (!t) break;
+            } else {
+                while (t < eol && !starts_[(uint8_t)*t]) t++;
+                if (t == eol) break;
+            }
+        }
+        if (!jit_.execute(t, bol, eol, captures_.data())) continue;
+        const char* match_end = captures_[1];
+        if (match_end == t && t == last_end) continue;
+
+        out.write(copied, t - copied);
+        for (const Piece& piece : pieces_) {
+            if (piece.group < 0) {
+                out << piece.text;
+            } else if (const char* begin = captures_[2 * piece.group]) {
+                out.write(begin, captures_[2 * piece.group + 1] - begin);
+            }
+        }
+        copied = match_end;
+        last_end = match_end;
+        if (match_end > t) t = match_end - 1;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "jit.h"
+#include "matcher.h"
+#include "regex.h"
+#include "stats.h"
+
+// Rewrites every match of a regex in its input, like sed -E 's/re/rep/g',
+// and prints all lines (-s). The matcher skips over runs of lines without
+// a match, and those go out straight from the input buffers; only lines
+// with a match run the pattern's JIT code with captures, at each offset
+// that can start a match, to find where each match and its groups are.
+// Matches are those of the backtracking JIT: leftmost, then the first the
+// pattern's order prefers.
+class Substituter {
+public:
+    // `finder` locates lines that match `root`. The replacement refers to
+    // group N as \N (\0 or & for the whole match); \& and \\ stand for
+    // themselves and \n for a newline. Throws if it refers to a group the
+    // pattern does not have.
+    Substituter(Matcher& finder, std::shared_ptr<Node> root, const std::string& replacement);
+
+    Substituter(const Substituter&) = delete;
+    Substituter& operator=(const Substituter&) = delete;
+
+    // Print `fd` to `out` with its matches replaced
+    void run(int fd, Stats& stats, std::ostream& out);
+
+private:
+    // Literal text, or group `group` (0 is the whole match) if >= 0
+    struct Piece {
+        std::string text;
+        int group;
+    };
+
+    void substitute(const char* bol, const char* eol, const char*& copied, std::ostream& out);
+
+    Matcher& finder_;
+    JIT jit_;
+    std::array<bool, 256> starts_; // bytes a match can start with
+    bool anywhere_ = true;         // or any offset, even the end of a line
+    int single_start_ = -1;        // the only byte in starts_, if one
+    std::vector<Piece> pieces_;
+    std::vector<const char*> captures_;
+};
@@ -0,0 +1,508 @@
+#include "trigram_index.h"
+#include "decompress.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+const char* const INDEX_FILE_NAME = ".jitgrep-index";
+
+// ---------------------------------------------------------------------------
+// Required trigrams of a regex
+
+// Sets of strings tracked per subexpression grow no larger than this; a set
+// that would is replaced by what is always true of it
+static const size_t MAX_STRINGS = 16;
+
+static TrigramQuery trigram_leaf(uint32_t trigram) {
+    TrigramQuery q;
+    q.op = TrigramQuery::TRIGRAM;
+    q.trigram = trigram;
+    return q;
+}
+
+// AND or OR of `args`, flattening nested uses of the same op and folding ALL
+static TrigramQuery combine(TrigramQuery::Op op, std::vector<TrigramQuery> args) {
+    TrigramQuery q;
+    q.op = op;
+    for (TrigramQuery& a : args) {
+        if (a.op == TrigramQuery::ALL) {
+            if (op == TrigramQuery::OR) return TrigramQuery();
+            continue;
+        }
+        if (a.op == op) {
+            for (TrigramQuery& inner : a.args) q.args.push_back(std::move(inner));
+        } else {
+            q.args.push_back(std::move(a));
+        }
+    }
+    if (q.args.empty()) return TrigramQuery();
+    if (q.args.size() == 1) return std::move(q.args[0]);
+    return q;
+}
+
+static uint32_t pack_trigram(const std::string& s, size_t i) {
+    return (uint32_t)(unsigned char)s[i] << 16 | (uint32_t)(unsigned char)s[i + 1] << 8
+        | (unsigned char)s[i + 2];
+}
+
+// All trigrams of `s`
+static TrigramQuery string_query(const std::string& s) {
+    std::vector<TrigramQuery> args;
+    for (size_t i = 0; i + 3 <= s.size(); i++) args.push_back(trigram_leaf(pack_trigram(s, i)));
+    return combine(TrigramQuery::AND, std::move(args));
+}
+
+// What is known about the strings a subexpression matches: either the
+// exact set of them, or some of their prefixes and suffixes (at most two
+// bytes each) plus a condition on the trigrams inside.
+struct Info {
+    bool exact = false;
+    std::set<std::string> strings;
+    std::set<std::string> prefix;
+    std::set<std::string> suffix;
+    TrigramQuery match;
+};
+
+static Info exact_info(std::set<std::string> strings) {
+    Info info;
+    info.exact = true;
+    info.strings = std::move(strings);
+    return info;
+}
+
+static Info unknown_info() {
+    Info info;
+    info.prefix.insert("");
+    info.suffix.insert("");
+    return info;
+}
+
+static std::set<std::string> capped(std::set<std::string> s) {
+    if (s.size() > MAX_STRINGS) return {""};
+    return s;
+}
+
+static std::set<std::string> product(const std::set<std::string>& a, const std::set<std::string>& b) {
+    std::set<std::string> out;
+    for (const std::string& x : a) {
+        for (const std::string& y : b) out.insert(x + y);
+    }
+    return out;
+}
+
+static std::set<std::string> heads(const std::set<std::string>& s) {
+    std::set<std::string> out;
+    for (const std::string& x : s) out.insert(x.substr(0, 2));
+    return capped(std::move(out));
+}
+
+static std::set<std::string> tails(const std::set<std::string>& s) {
+    std::set<std::string> out;
+    for (const std::string& x : s) out.insert(x.size() > 2 ? x.substr(x.size() - 2) : x);
+    return capped(std::move(out));
+}
+
+// Trade an exact set for its prefixes, suffixes and trigrams
+static void make_inexact(Info& info) {
+    if (!info.exact) return;
+    std::vector<TrigramQuery> any;
+    for (const std::string& s : info.strings) any.push_back(string_query(s));
+    info.match = combine(TrigramQuery::OR, std::move(any));
+    info.prefix = heads(info.strings);
+    info.suffix = tails(info.strings);
+    info.exact = false;
+    info.strings.clear();
+}
+
+static Info analyze(const Node* node) {
+    if (!node) return exact_info({""}); // empty branch, as in a| or ()
+    switch (node->type) {
+        case NODE_CHAR:
+            return exact_info({std::string(1, static_cast<const CharNode*>(node)->c)});
+        case NODE_START:
+        case NODE_END:
+            return exact_info({""});
+        case NODE_ANY:
+        case NODE_STAR:
+            return unknown_info();
+        case NODE_ATOMIC:
+            // Matches no more than the child on its own would
+            return analyze(static_cast<const AtomicNode*>(node)->child.get());
+        case NODE_GROUP:
+            return analyze(static_cast<const GroupNode*>(node)->child.get());
+        case NODE_OR: {
+            auto* n = static_cast<const OrNode*>(node);
+            Info a = analyze(n->left.get());
+            Info b = analyze(n->right.get());
+            if (a.exact && b.exact && a.strings.size() + b.strings.size() <= MAX_STRINGS) {
+                a.strings.insert(b.strings.begin(), b.strings.end());
+                return a;
+            }
+            make_inexact(a);
+            make_inexact(b);
+            Info info;
+            info.prefix = a.prefix;
+            info.prefix.insert(b.prefix.begin(), b.prefix.end());
+            info.prefix = capped(std::move(info.prefix));
+            info.suffix = a.suffix;
+            info.suffix.insert(b.suffix.begin(), b.suffix.end());
+            info.suffix = capped(std::move(info.suffix));
+            info.match = combine(TrigramQuery::OR, {std::move(a.match), std::move(b.match)});
+            return info;
+        }
+        case NODE_CONCAT: {
+            auto* n = static_cast<const ConcatNode*>(node);
+            Info a = analyze(n->left.get());
+            Info b = analyze(n->right.get());
+            if (a.exact && b.exact && a.strings.size() * b.strings.size() <= MAX_STRINGS) {
+                return exact_info(product(a.strings, b.strings));
+            }
+            bool a_exact = a.exact;
+            bool b_exact = b.exact;
+            std::set<std::string> a_strings = a.strings;
+            std::set<std::string> b_strings = b.strings;
+            make_inexact(a);
+            make_inexact(b);
+
+            // An exact side extends the other side's prefix or suffix
+            Info info;
+            info.prefix = a_exact ? heads(product(a_strings, b.prefix)) : a.prefix;
+            info.suffix = b_exact ? tails(product(a.suffix, b_strings)) : b.suffix;
+
+            // Trigrams straddling the boundary
+            std::vector<TrigramQuery> across;
+            for (const std::string& x : a.suffix) {
+                for (const std::string& y : b.prefix) across.push_back(string_query(x + y));
+            }
+            info.match = combine(TrigramQuery::AND,
+                                 {std::move(a.match), std::move(b.match),
+                                  combine(TrigramQuery::OR, std::move(across))});
+            return info;
+        }
+    }
+    return unknown_info();
+}
+
+TrigramQuery trigram_query(const std::vector<std::shared_ptr<Node>>& roots) {
+    std::vector<TrigramQuery> any;
+    for (const auto& root : roots) {
+        if (!root) return TrigramQuery(); // the empty pattern matches every line
+        Info info = analyze(root.get());
+        make_inexact(info);
+        any.push_back(std::move(info.match));
+    }
+    return combine(TrigramQuery::OR, std::move(any));
+}
+
+// ---------------------------------------------------------------------------
+// Index file: header, files, trigrams (sorted), NUL-terminated names, and
+// posting lists of file numbers as LEB128 deltas
+
+static const char INDEX_MAGIC[8] = {'J', 'G', 'I', 'D', 'X', '0', '1', '\n'};
+
+struct IndexHeader {
+    char magic[8];
+    uint32_t files;
+    uint32_t trigrams;
+    uint64_t names_size;
+    uint64_t postings_size;
+};
+
+struct IndexFile {
+    uint64_t name; // offset into the names
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+struct IndexTrigram {
+    uint32_t trigram;
+    uint32_t count;   // files in the posting list
+    uint64_t offset;  // into the posting lists
+};
+
+static const size_t READ_SIZE = 1 << 20;
+
+// Append the regular files under `dir`/`rel` to `names`, relative to `dir`.
+// Symlinks are not followed, and the index itself is skipped.
+static bool list_files(const std::string& dir, const std::string& rel, std::vector<std::string>& names) {
+    std::string path = rel.empty() ? dir : dir + "/" + rel;
+    DIR* d = opendir(path.c_str());
+    if (!d) {
+        std::cerr << "Error: " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    bool ok = true;
+    while (dirent* e = readdir(d)) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        if (rel.empty() && strncmp(e->d_name, INDEX_FILE_NAME, strlen(INDEX_FILE_NAME)) == 0) continue;
+        std::string name = rel.empty() ? e->d_name : rel + "/" + e->d_name;
+        struct stat st;
+        if (lstat((dir + "/" + name).c_str(), &st) != 0) {
+            std::cerr << "Error: " << dir << "/" << name << ": " << strerror(errno) << std::endl;
+            ok = false;
+        } else if (S_ISDIR(st.st_mode)) {
+            ok &= list_files(dir, name, names);
+        } else if (S_ISREG(st.st_mode)) {
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+    return ok;
+}
+
+// Collect the trigrams within lines of `fd`: each one not yet set in `seen`
+// is set there and appended to `found`
+static void scan_trigrams(int fd, std::vector<uint64_t>& seen, std::vector<uint32_t>& found,
+                          std::vector<char>& buf) {
+    auto source = open_source(fd);
+    uint32_t t = 0;
+    int len = 0; // bytes of the current line in `t`, up to 3
+    while (size_t n = source->read(buf.data(), buf.size())) {
+        for (size_t i = 0; i < n; i++) {
+            unsigned char c = buf[i];
+            if (c == '\n') {
+                len = 0;
+                continue;
+            }
+            t = (t << 8 | c) & 0xFFFFFF;
+            if (len < 2) {
+                len++;
+                continue;
+            }
+            uint64_t bit = 1ull << (t & 63);
+            uint64_t& word = seen[t >> 6];
+            if (!(word & bit)) {
+                word |= bit;
+                found.push_back(t);
+            }
+        }
+    }
+}
+
+static void put_varint(std::string& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+bool build_trigram_index(const std::string& dir) {
+    std::vector<std::string> names;
+    bool ok = list_files(dir, "", names);
+    std::sort(names.begin(), names.end());
+
+    std::vector<IndexFile> files;
+    std::string name_data;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> lists;
+    std::vector<uint64_t> seen(1 << 18);
+    std::vector<uint32_t> found;
+    std::vector<char> buf(READ_SIZE);
+
+    for (const std::string& name : names) {
+        std::string path = dir + "/" + name;
+        found.clear();
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        bool read_ok = fd >= 0 && fstat(fd, &st) == 0;
+        if (!read_ok) {
+            std::cerr << "Error: " << path << ": " << strerror(errno) << std::endl;
+        } else {
+            try {
+                scan_trigrams(fd, seen, found, buf);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << path << ": " << e.what() << std::endl;
+                read_ok = false;
+            }
+        }
+        if (fd >= 0) close(fd);
+        for (uint32_t t : found) seen[t >> 6] = 0;
+        if (!read_ok) {
+            ok = false;
+            continue;
+        }
+
+        uint32_t id = (uint32_t)files.size();
+        for (uint32_t t : found) lists[t].push_back(id);
+        files.push_back({name_data.size(), (uint64_t)st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec});
+        name_data.append(name).push_back('\0');
+    }
+
+    std::vector<IndexTrigram> trigrams;
+    trigrams.reserve(lists.size());
+    for (const auto& entry : lists) trigrams.push_back({entry.first, (uint32_t)entry.second.size(), 0});
+    std::sort(trigrams.begin(), trigrams.end(),
+              [](const IndexTrigram& a, const IndexTrigram& b) { return a.trigram < b.trigram; });
+
+    std::string posting_data;
+    for (IndexTrigram& t : trigrams) {
+        t.offset = posting_data.size();
+        uint32_t prev = 0;
+        for (uint32_t id : lists[t.trigram]) {
+            put_varint(posting_data, id - prev);
+            prev = id;
+        }
+    }
+
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof header.magic);
+    header.files = (uint32_t)files.size();
+    header.trigrams = (uint32_t)trigrams.size();
+    header.names_size = name_data.size();
+    header.postings_size = posting_data.size();
+
+    // Written aside and renamed over the old index, so searches running
+    // meanwhile see one or the other
+    std::string path = dir + "/" + INDEX_FILE_NAME;
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error(tmp + ": " + strerror(errno));
+    out.write(reinterpret_cast<const char*>(&header), sizeof header);
+    out.write(reinterpret_cast<const char*>(files.data()), files.size() * sizeof(IndexFile));
+    out.write(reinterpret_cast<const char*>(trigrams.data()), trigrams.size() * sizeof(IndexTrigram));
+    out.write(name_data.data(), name_data.size());
+    out.write(posting_data.data(), posting_data.size());
+    out.close();
+    if (!out) {
+        unlink(tmp.c_str());
+        throw std::runtime_error(tmp + ": write failed");
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        int err = errno;
+        unlink(tmp.c_str());
+        throw std::runtime_error(path + ": " + strerror(err));
+    }
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Searching the index
+
+TrigramIndex::TrigramIndex(const std::string& dir) : dir_(dir) {
+    std::string path = dir + "/" + INDEX_FILE_NAME;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error(path + ": " + strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error(path + ": " + strerror(err));
+    }
+    size_ = st.st_size;
+    void* p = size_ ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error(path + ": not a jitgrep index");
+    data_ = static_cast<const unsigned char*>(p);
+
+    IndexHeader header;
+    bool valid = size_ >= sizeof header;
+    if (valid) {
+        memcpy(&header, data_, sizeof header);
+        valid = memcmp(header.magic, INDEX_MAGIC, sizeof header.magic) == 0
+            && size_ == sizeof header + (uint64_t)header.files * sizeof(IndexFile)
+                + (uint64_t)header.trigrams * sizeof(IndexTrigram) + header.names_size + header.postings_size;
+    }
+    if (!valid) {
+        munmap(const_cast<unsigned char*>(data_), size_);
+        throw std::runtime_error(path + ": not a jitgrep index");
+    }
+
+    file_count_ = header.files;
+    trigram_count_ = header.trigrams;
+    const unsigned char* at = data_ + sizeof header;
+    files_ = reinterpret_cast<const IndexFile*>(at);
+    at += file_count_ * sizeof(IndexFile);
+    trigrams_ = reinterpret_cast<const IndexTrigram*>(at);
+    at += trigram_count_ * sizeof(IndexTrigram);
+    names_ = reinterpret_cast<const char*>(at);
+    postings_ = at + header.names_size;
+}
+
+TrigramIndex::~TrigramIndex() {
+    munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+std::vector<uint32_t> TrigramIndex::postings(uint32_t trigram) const {
+    const IndexTrigram* end = trigrams_ + trigram_count_;
+    const IndexTrigram* t = std::lower_bound(trigrams_, end, trigram,
+                                             [](const IndexTrigram& a, uint32_t b) { return a.trigram < b; });
+    std::vector<uint32_t> ids;
+    if (t == end || t->trigram != trigram) return ids;
+    ids.reserve(t->count);
+    const unsigned char* p = postings_ + t->offset;
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < t->count; i++) {
+        uint32_t delta = 0;
+        for (int shift = 0;; shift += 7) {
+            unsigned char b = *p++;
+            delta |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+        id += delta;
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+std::vector<uint32_t> TrigramIndex::evaluate(const TrigramQuery& query) const {
+    std::vector<uint32_t> ids;
+    switch (query.op) {
+        case TrigramQuery::ALL:
+            for (uint32_t i = 0; i < file_count_; i++) ids.push_back(i);
+            break;
+        case TrigramQuery::TRIGRAM:
+            ids = postings(query.trigram);
+            break;
+        case TrigramQuery::AND:
+            for (size_t i = 0; i < query.args.size(); i++) {
+                std::vector<uint32_t> next = evaluate(query.args[i]);
+                if (i == 0) {
+                    ids = std::move(next);
+                } else {
+                    std::vector<uint32_t> both;
+                    std::set_intersection(ids.begin(), ids.end(), next.begin(), next.end(),
+                                          std::back_inserter(both));
+                    ids = std::move(both);
+                }
+                if (ids.empty()) break;
+            }
+            break;
+        case TrigramQuery::OR:
+            for (const TrigramQuery& arg : query.args) {
+                std::vector<uint32_t> next = evaluate(arg);
+                std::vector<uint32_t> either;
+                std::set_union(ids.begin(), ids.end(), next.begin(), next.end(), std::back_inserter(either));
+                ids = std::move(either);
+            }
+            break;
+    }
+    return ids;
+}
+
+std::vector<std::string> TrigramIndex::candidates(const TrigramQuery& query) const {
+    std::vector<bool> hit(file_count_);
+    for (uint32_t id : evaluate(query)) hit[id] = true;
+
+    std::vector<std::string> paths;
+    for (uint32_t i = 0; i < file_count_; i++) {
+        const IndexFile& f = files_[i];
+        std::string path = dir_ + "/" + (names_ + f.name);
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        bool changed = (uint64_t)st.st_size != f.size || st.st_mtim.tv_sec != f.mtime_sec
+            || st.st_mtim.tv_nsec != f.mtime_nsec;
+        if (hit[i] || changed) paths.push_back(std::move(path));
+    }
+    return paths;
+}
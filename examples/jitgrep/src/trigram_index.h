@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "regex.h"
+
+// A condition on the trigrams (three-byte substrings, packed into the low
+// 24 bits) that a line must contain for a regex to match it. ALL holds for
+// any input; AND and OR combine `args`.
+struct TrigramQuery {
+    enum Op { ALL, TRIGRAM, AND, OR };
+    Op op = ALL;
+    uint32_t trigram = 0;
+    std::vector<TrigramQuery> args;
+};
+
+// The trigrams every match of any of `roots` must contain. Derived from the
+// syntax tree, so it only ever errs towards ALL.
+TrigramQuery trigram_query(const std::vector<std::shared_ptr<Node>>& roots);
+
+// On-disk records, laid out in trigram_index.cpp
+struct IndexFile;
+struct IndexTrigram;
+
+// Name of the index file that `jitgrep index DIR` writes into DIR
+extern const char* const INDEX_FILE_NAME;
+
+// Index every regular file under `dir` (decompressing gzip and zstd like a
+// search would) and write DIR/.jitgrep-index, replacing any old one
+// atomically. Files that cannot be read are reported on stderr and left out.
+// Returns false if any were.
+bool build_trigram_index(const std::string& dir);
+
+// A read-only, mmapped index written by build_trigram_index(): the file
+// list, and for each trigram a delta-encoded posting list of the files
+// holding it somewhere within a line.
+class TrigramIndex {
+public:
+    explicit TrigramIndex(const std::string& dir);
+    ~TrigramIndex();
+
+    TrigramIndex(const TrigramIndex&) = delete;
+    TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+    size_t file_count() const { return file_count_; }
+
+    // Paths of the files that may hold a match for `query`, in index order:
+    // those whose trigrams satisfy it, plus any whose size or mtime changed
+    // since indexing. Files deleted since are left out; files added since are
+    // not known until DIR is indexed again.
+    std::vector<std::string> candidates(const TrigramQuery& query) const;
+
+private:
+    std::vector<uint32_t> evaluate(const TrigramQuery& query) const;
+    std::vector<uint32_t> postings(uint32_t trigram) const;
+
+    std::string dir_;
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+    uint32_t file_count_ = 0;
+    uint32_t trigram_count_ = 0;
+    const IndexFile* files_ = nullptr;
+    const IndexTrigram* trigrams_ = nullptr;
+    const char* names_ = nullptr;
+    const unsigned char* postings_ = nullptr;
+};
@@ -0,0 +1,379 @@
+#!/bin/sh
+# Regression checks for jitgrep (make check). Each check runs jitgrep and
+# another command that should print the same bytes, another engine of
+# jitgrep's own or a standard tool, over inputs generated here; checks
+# whose tool is missing are skipped. Patterns keep to what both sides
+# read alike: jitgrep has no ?, + or [], and picks the leftmost match the
+# pattern's order prefers rather than the longest.
+#
+#   tests/check.sh [path to jitgrep]
+
+JITGREP=${1:-./jitgrep}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+export LC_ALL=C
+
+passed=0
+failed=0
+skipped=0
+
+# same NAME COMMAND EXPECTED: COMMAND (run by sh, with $J for jitgrep)
+# prints what EXPECTED prints, on stdout and stderr. Exit statuses are not
+# compared: jitgrep exits 0 when nothing matches.
+same() {
+    J=$JITGREP sh -c "$2" >"$TMP/got" 2>&1
+    J=$JITGREP sh -c "$3" >"$TMP/want" 2>&1
+    if cmp -s "$TMP/got" "$TMP/want"; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL $1"
+        echo "  got:  $2"
+        echo "  want: $3"
+        diff "$TMP/want" "$TMP/got" | head -5 | sed 's/^/  /'
+    fi
+}
+
+skip() {
+    skipped=$((skipped + 1))
+    echo "skip $1"
+}
+
+# Log-like lines of 2-12 words from a small vocabulary, some empty, from a
+# fixed seed: about `$2` lines into `$1`
+make_log() {
+    awk -v lines="$2" 'BEGIN {
+        srand(7)
+        split("get put error ok id5 timeout foo bar abc aaa x y retry ms99 a.b", words, " ")
+        for (i = 0; i < lines; i++) {
+            if (rand() < 0.02) { print ""; continue }
+            n = 2 + int(rand() * 11)
+            line = ""
+            for (w = 0; w < n; w++) line = line (w ? " " : "") words[1 + int(rand() * 15)] int(rand() * 100)
+            print line
+        }
+    }' >"$1"
+}
+
+LOG="$TMP/log"    # a few MB, so context and reads cross buffers
+SMALL="$TMP/small"
+make_log "$LOG" 60000
+make_log "$SMALL" 300
+printf 'last line without newline' >>"$SMALL"
+
+# Reader (AsyncReader): input through a pipe in small pieces, and a line
+# longer than a reader buffer, give what the file gives
+same "reader: pipe" "cat '$LOG' | \$J 'error1'" "\$J 'error1' '$LOG'"
+awk 'BEGIN { for (i = 0; i < 300000; i++) printf "abcdefghij"; print "needle"; print "tail needle" }' >"$TMP/long"
+same "reader: long line in small writes" \
+    "dd if='$TMP/long' bs=4096 2>/dev/null | \$J -e needle -e tail | cksum" "\$J -e needle -e tail '$TMP/long' | cksum"
+same "reader: no final newline" "cat '$SMALL' | \$J 'newline'" "echo 'last line without newline'"
+
+# Context (-A, -B, -C) against GNU grep, across buffers and files, with -n
+# and with -A/-B given before or after -C
+if grep --version 2>/dev/null | grep -q GNU; then
+    for opts in "-B 1" "-B 3" "-A 2" "-C 2" "-A 5 -B 40" "-n -C 3" "-B 100000" "-A 2 -C 5" "-C 5 -B 0" "-C 1 -C 3"; do
+        for pattern in 'timeout1 ' 'ms997$' 'zzz'; do
+            same "context: $opts '$pattern'" "\$J $opts '$pattern' '$LOG'" "grep $opts '$pattern' '$LOG'"
+        done
+    done
+    same "context: files" "\$J -B 2 -A 1 'ms99' '$SMALL' '$LOG'" "grep -B 2 -A 1 'ms99' '$SMALL' '$LOG'"
+else
+    skip "context: no GNU grep"
+fi
+
+# --stream offsets against awk, for literals: each matching line's start
+# and the end of its earliest-ending match, as byte offsets
+stream_offsets() {
+    awk -v literals="$1" 'BEGIN { n = split(literals, lit, "|"); offset = 0 }
+    {
+        end = 0
+        for (i = 1; i <= n; i++) {
+            at = index($0, lit[i])
+            if (at && (!end || at + length(lit[i]) - 1 < end)) end = at + length(lit[i]) - 1
+        }
+        if (end) print offset "," offset + end
+        offset += length($0) + 1
+    }' "$2" >"$TMP/offsets"
+}
+for literals in 'timeout1 ' 'ms99' 'get4|ok77' 'a.b'; do
+    stream_offsets "$literals" "$LOG"
+    patterns=$(echo "$literals" | sed "s/^/-e '/; s/|/' -e '/g; s/\$/'/")
+    same "stream: $literals" "\$J --stream -F $patterns '$LOG'" "cat '$TMP/offsets'"
+done
+stream_offsets 'newline' "$SMALL"
+same "stream: no final newline" "\$J --stream 'newline' '$SMALL'" "cat '$TMP/offsets'"
+same "stream: pipe" "cat '$LOG' | \$J --stream 'error1'" "\$J --stream 'error1' '$LOG'"
+
+# -s against sed -E, with groups, & and empty matches
+if sed --version 2>/dev/null | grep -q GNU; then
+    while read -r pattern replacement; do
+        same "substitute: s/$pattern/$replacement/" "\$J -s '$pattern' '$replacement' '$SMALL'" \
+            "sed -E 's/$pattern/$replacement/g' '$SMALL'"
+    done <<'CASES'
+x* -
+a* <&>
+^ >
+$ ;
+(t)(i)(m)e \3\2\1
+^(get)(.) \2-\1
+(e)(r*)(o) [\3\2\1]
+(ms)(9)(9*) \2\3\1\1
+o(k)|(i)d \1\2
+CASES
+    same "substitute: whole log" "\$J -s '(id)(5)' '\2\1' '$LOG' | cksum" "sed -E 's/(id)(5)/\2\1/g' '$LOG' | cksum"
+else
+    skip "substitute: no GNU sed"
+fi
+
+# -k and -d against awk's fields
+tr ' ' '\t' <"$LOG" >"$TMP/tabs"
+tr ' ' ',' <"$LOG" >"$TMP/commas"
+for case in '1 ^get' '2 5$' '2 ^id5.$' '3 e.*r' '12 ms99' '4 ^$'; do
+    field=${case%% *}
+    pattern=${case#* }
+    same "fields: -k $field '$pattern'" "\$J -k $field '$pattern' '$TMP/tabs'" \
+        "awk -F '\t' 'NF >= $field && \$$field ~ /$pattern/' '$TMP/tabs'"
+    same "fields: -d , -k $field '$pattern'" "\$J -d , -k $field '$pattern' '$TMP/commas'" \
+        "awk -F , 'NF >= $field && \$$field ~ /$pattern/' '$TMP/commas'"
+done
+printf 'a\t\tb\n\t\t\n\n\tx\nab\tb\tc\n' >"$TMP/empty_fields"
+for pattern in '^$' 'b*' 'x'; do
+    same "fields: empty fields, '$pattern'" "\$J -k 2 '$pattern' '$TMP/empty_fields'" \
+        "awk -F '\t' 'NF >= 2 && \$2 ~ /$pattern/' '$TMP/empty_fields'"
+done
+
+# Engines against the backtracking JIT, on the log and on lines around the
+# lengths where --engine=lanes switches to one line at a time
+awk 'BEGIN {
+    srand(11)
+    for (i = 0; i < 2000; i++) {
+        n = int(rand() * 600)
+        line = ""
+        for (c = 0; c < n; c++) line = line substr("abcxyz ok5", 1 + int(rand() * 10), 1)
+        print line
+    }
+}' >"$TMP/lengths"
+# Small enough for every engine
+ENGINE_PATTERNS='error1
+ms99$
+^get.*ok
+id5 ok
+(ge|pu)t1.*x
+a.b
+a\.b
+^$
+x*
+^(a|b)*c
+(ab|ba)*$
+ok5$
+zz'
+# check_engine ENGINE PATTERNS, one per line
+check_engine() {
+    while read -r pattern; do
+        for input in "$LOG" "$SMALL" "$TMP/lengths"; do
+            same "engine $1: '$pattern' $(basename "$input")" "\$J --engine=$1 '$pattern' '$input' | cksum" \
+                "\$J --engine=backtrack '$pattern' '$input' | cksum"
+        done
+    done <<PATTERNS
+$2
+PATTERNS
+}
+check_engine aot "$ENGINE_PATTERNS
+(get|put|post)1.* x
+a1|b2|c3|d4|e5|f6|g7|h8|i9|j0|k1|l2|m3"
+same "engine aot: too many states" "\$J --engine=aot '(a|b)*a$(printf '(a|b)%.0s' $(seq 11))' '$SMALL'" \
+    "echo 'Error: pattern needs more than 1024 DFA states for --engine=aot'"
+check_engine lanes "$ENGINE_PATTERNS"
+check_engine dfa "$ENGINE_PATTERNS
+(get|put|post)1.* x
+a1|b2|c3|d4|e5|f6|g7|h8|i9|j0|k1|l2|m3"
+check_engine nfa "$ENGINE_PATTERNS
+(get|put|post)1.* x
+a1|b2|c3|d4|e5|f6|g7|h8|i9|j0|k1|l2|m3"
+same "engine nfa: too many positions" "\$J --engine=nfa '$(printf 'abcdefgh%.0s' $(seq 9))' '$SMALL'" \
+    "echo 'Error: pattern has more than 64 positions for --engine=nfa'"
+same "engine lanes: too many states" "\$J --engine=lanes 'abcdefghijklmnopq' '$SMALL'" \
+    "echo 'Error: pattern needs more than 14 DFA states for --engine=lanes'"
+same "engine lanes: too many ranges" "\$J --engine=lanes 'a|c|e|g|i|k|m|o|q|s|u|w|y|0|2|4|6' '$SMALL'" \
+    "echo 'Error: pattern tells apart more than 16 byte ranges for --engine=lanes'"
+
+# Fixed strings (-F, and -f sets of them) against the backtracking engine
+# on the same strings with their metacharacters escaped
+printf '%s\n' 'a.b (x) * ^get $ | \ end' 'axb x* ^^ $$' '(x|y)' 'a\.b' '' '.*' 'tail\' >"$TMP/meta"
+cat "$SMALL" >>"$TMP/meta"
+escape() {
+    sed 's/[.*|()^$\\]/\\&/g'
+}
+for needle in 'a.b' 'ms99' 'x' '(x' '*' '^get' '$' '|' '\' 'id5 ok' '.*' 'newline'; do
+    regex=$(printf '%s\n' "$needle" | escape)
+    for input in "$LOG" "$TMP/meta"; do
+        same "fixed: -F '$needle' $(basename "$input")" "\$J -F '$needle' '$input' | cksum" \
+            "\$J --engine=backtrack '$regex' '$input' | cksum"
+    done
+done
+
+# -f: every needle in the file at once (Aho-Corasick), against the escaped
+# needles joined with |. Sets with needles inside other needles, a needle
+# given twice, and an empty needle, which matches every line
+# check_needles OPTIONS NEEDLE...
+check_needles() {
+    opts=$1
+    shift
+    printf '%s\n' "$@" >"$TMP/needles"
+    regex=$(escape <"$TMP/needles" | paste -sd'|' -)
+    for input in "$LOG" "$TMP/meta"; do
+        same "fixed: $opts $* $(basename "$input")" "\$J $opts '$TMP/needles' '$input' | cksum" \
+            "\$J --engine=backtrack '$regex' '$input' | cksum"
+    done
+}
+check_needles -f error1 ms99 'id5 ok'
+check_needles -f ms9 ms99 s99 9 ms990
+check_needles -f bc abcd b x
+check_needles -f get4 get4 put
+check_needles -f zzz '' abc
+check_needles '-F -f' a.b '(x' '$$' '\' '*'
+
+# --ids against one backtracking run per pattern: each line some pattern
+# matches, after the numbers of the patterns that match it
+# check_ids INPUT PATTERN...
+check_ids() {
+    input=$1
+    shift
+    : >"$TMP/hits"
+    i=1
+    args=
+    for pattern in "$@"; do
+        "$JITGREP" --engine=backtrack -n "$pattern" "$input" | sed "s/:.*/ $i/" >>"$TMP/hits"
+        args="$args -e '$pattern'"
+        i=$((i + 1))
+    done
+    awk 'FNR == NR { if ($1 in ids) ids[$1] = ids[$1] ","; ids[$1] = ids[$1] $2; next }
+         FNR in ids { print ids[FNR] ":" $0 > ids_file; print FNR ":" ids[FNR] ":" $0 > numbered_file }' \
+        ids_file="$TMP/ids" numbered_file="$TMP/ids_n" "$TMP/hits" "$input"
+    same "ids: $* $(basename "$input")" "\$J --ids $args '$input' | cksum" "cksum <'$TMP/ids'"
+    same "ids: -n $* $(basename "$input")" "\$J --ids -n $args '$input' | cksum" "cksum <'$TMP/ids_n'"
+}
+for input in "$LOG" "$SMALL"; do
+    check_ids "$input" error1 'ms99$' '^get.*ok' 'id5 ok'
+    check_ids "$input" 'x*' zz 'a\.b' '^$'
+    check_ids "$input" '(ge|pu)t1.*x' get1 'error1|ok1' newline
+done
+check_ids "$TMP/meta" bc abcd b x 'a\.b'
+
+# NUL is an ordinary byte: inside a line, right before '\n', and under a
+# '.' that matches across it, against GNU grep -a
+if grep --version 2>/dev/null | grep -q GNU; then
+    printf 'ab\0cd\nx\0\n\0\nerror1\0ok\nplain\n\0\0a\n' >"$TMP/nul"
+    tr ' ' '\0' <"$SMALL" >"$TMP/nul_small"
+    for engine in backtrack nfa; do
+        for pattern in 'cd' 'b.c' 'ab.*cd' 'x.$' '^.$' 'error1.ok' '^..a' '^$' 'ok$'; do
+            same "nul: --engine=$engine '$pattern'" "\$J --engine=$engine '$pattern' '$TMP/nul'" \
+                "grep -a '$pattern' '$TMP/nul'"
+        done
+        for pattern in 'get1.*x' 'ms9.*id5' '9.$' 'error1'; do
+            same "nul: --engine=$engine '$pattern' small" "\$J --engine=$engine -n '$pattern' '$TMP/nul_small'" \
+                "grep -a -n '$pattern' '$TMP/nul_small'"
+        done
+    done
+else
+    skip "nul: no GNU grep"
+fi
+
+# Lazy (*?), possessive (*+) and atomic ((?>...)) constructs against perl,
+# on patterns where they select or replace otherwise than a greedy star
+# would, and on stars over groups that can match empty. For -s with empty
+# matches, perl retries an empty match's position, so there the reference
+# is sed with the construct's greedy equivalent: a*? alone matches empty,
+# and a trailing a*+ matches what a* does
+printf '%s\n' aaa aab b xyz 'xay xby' 'ab aab' '' xz 'aaaab aab' xxay >"$TMP/quantifiers"
+if command -v perl >/dev/null 2>&1; then
+    for pattern in 'a*+a' '(?>a*)ab' '(?>aa*)b' '(?>x|xy)z' 'x.*?y' 'a*?b' 'get.*+1' '(?>e.*)r' \
+        '(a*)*+' '(b*)*' '(a*)*+b' '(x*)*y' '(a*?)*z' '((?>a*))*b' '(a*+|b)*+$'; do
+        for input in "$TMP/quantifiers" "$LOG"; do
+            same "quantifiers: '$pattern' $(basename "$input")" "\$J '$pattern' '$input' | cksum" \
+                "perl -ne 'print if /(?:$pattern)/' '$input' | cksum"
+        done
+    done
+    while read -r pattern replacement; do
+        same "quantifiers: s/$pattern/$replacement/" "\$J -s '$pattern' '$replacement' '$TMP/quantifiers'" \
+            "perl -pe 's/$pattern/$replacement/g' '$TMP/quantifiers'"
+    done <<'CASES'
+(a*?)(a*)b [\1|\2]
+x(.*?)y <\1>
+(a*+)b {\1}
+((?>a*))b {\1}
+(?>x|xy)(.) \1
+(a*)*+b =
+(a*?)*z =
+(e.*?)(r.*) \2\1
+CASES
+    same "quantifiers: s/(e.*?)(r.*)/ whole log" "\$J -s '(e.*?)(r.*)' '\2\1' '$LOG' | cksum" \
+        "perl -pe 's/(e.*?)(r.*)/\2\1/g' '$LOG' | cksum"
+else
+    skip "quantifiers: no perl"
+fi
+if sed --version 2>/dev/null | grep -q GNU; then
+    while read -r pattern greedy; do
+        same "quantifiers: s/$pattern/<\1>/" "\$J -s '$pattern' '<\1>' '$TMP/quantifiers'" \
+            "sed -E 's/$greedy/<\1>/g' '$TMP/quantifiers'"
+    done <<'CASES'
+(a*?) ()
+(a*+) (a*)
+x(a*?) x()
+(x*+)(a*?) (x*)()
+CASES
+else
+    skip "quantifiers: no GNU sed"
+fi
+
+# A search run twice on one --serve server, the second time on the engines
+# the first compiled, prints the same lines and the same counters; only
+# timings and the cost of compiling may differ
+"$JITGREP" --serve "$TMP/socket" >/dev/null 2>&1 &
+server=$!
+trap 'kill $server; rm -rf "$TMP"' EXIT
+i=0
+while [ ! -S "$TMP/socket" ] && [ $i -lt 50 ]; do
+    sleep 0.1
+    i=$((i + 1))
+done
+# served FILE ARGS: the output and counters of a search with ARGS, one
+# string quoted for sh, run by the server or, with an empty FILE, locally
+served() {
+    sh -c "'$JITGREP' ${1:+--connect='$TMP/socket'} $2" >"$TMP/served$1" 2>"$TMP/stats"
+    sed '/time:/d; /wait:/d; /^throughput:/d; s/, [0-9]* syscalls to compile//' "$TMP/stats" >>"$TMP/served$1"
+}
+# check_served ARGS
+check_served() {
+    served 1 "$1"
+    served 2 "$1"
+    same "served: $1" "cat '$TMP/served2'" "cat '$TMP/served1'"
+}
+check_served "--stats=frames --engine=backtrack 'e.*r' '$LOG'"
+check_served "--stats 'e.*r' '$LOG'"
+check_served "--stats -k 2 'ok.*' '$TMP/tabs'"
+check_served "--stats --ids -e error1 -e 'ms9.*' '$LOG'"
+check_served "--stats -s '(e.*?)(r)' '\2\1' '$SMALL'"
+# Searches on the same patterns with options that pick other engines, or
+# another replacement, get engines of their own, as the same search run
+# locally shows (there the arena's chunks are only this search's)
+check_after() {
+    served 1 "$1"
+    served 1 "$2"
+    served "" "$2"
+    same "served: $2 after $1" "grep -v '^code arena:' '$TMP/served1'" "grep -v '^code arena:' '$TMP/served'"
+}
+check_after "--stats ms99 '$LOG'" "--stats -e ms99 '$LOG'"
+check_after "--stats -e ms99 '$LOG'" "--stats -F ms99 '$LOG'"
+check_after "--stats ms99 '$LOG'" "--stats --engine=dfa ms99 '$LOG'"
+check_after "--stats -s '(e)(r)' '\2\1' '$SMALL'" "--stats -s '(e)(r)' '<\1>' '$SMALL'"
+# With --pgo a kept engine goes on from the profile and phase it reached,
+# so only the lines are the same
+for run in 1 2; do
+    same "served: --pgo, run $run" "\$J --connect='$TMP/socket' --pgo=1000 'get1|put1|ok5' '$LOG' | cksum" \
+        "\$J --pgo=1000 'get1|put1|ok5' '$LOG' | cksum"
+done
+
+echo "$passed passed, $failed failed, $skipped skipped"
+[ $failed -eq 0 ]